@@ -57,6 +57,22 @@ extern volatile uint32_t		gWarpI2cBaudRateKbps;
 extern volatile uint32_t		gWarpI2cTimeoutMilliseconds;
 extern volatile uint32_t		gWarpSupplySettlingDelayMilliseconds;
 
+/*
+ *	Any register can be read (the pixel registers run up to 0xFF); only
+ *	the control, status-clear, averaging and interrupt registers
+ *	(0x00-0x03, 0x05, 0x07-0x0D) can be written.
+ */
+static const uint32_t	writableRegistersAMG8834[] = {0x00003FAF};
+
+static const WarpRegmap	regmapAMG8834 =
+{
+	.registerCount	= 0x100,
+	.registerBytes	= 1,
+	.flags		= kWarpRegmapFlagAutoIncrement,
+	.readable	= NULL,
+	.writable	= writableRegistersAMG8834,
+};
+
 
 /*
  *	AMG8834.
@@ -74,47 +90,7 @@ initAMG8834(const uint8_t i2cAddress, WarpI2CDeviceState volatile *  deviceState
 WarpStatus
 writeSensorRegisterAMG8834(uint8_t deviceRegister, uint8_t payload, uint16_t menuI2cPullupValue)
 {
-	uint8_t		payloadByte[1], commandByte[1];
-	i2c_status_t	returnValue;
-
-	switch (deviceRegister)
-	{
-		case 0x00: case 0x01: case 0x02: case 0x03:
-		case 0x05: case 0x07: case 0x08: case 0x09:
-		case 0x0A: case 0x0B: case 0x0C: case 0x0D:
-		{
-			/* OK */
-			break;
-		}
-		
-		default:
-		{
-			return kWarpStatusBadDeviceCommand;
-		}
-	}
-
-	i2c_device_t slave =
-	{
-		.address = deviceAMG8834State.i2cAddress,
-		.baudRate_kbps = gWarpI2cBaudRateKbps
-	};
-
-	commandByte[0] = deviceRegister;
-	payloadByte[0] = payload;
-	returnValue = I2C_DRV_MasterSendDataBlocking(
-							0 /* I2C instance */,
-							&slave,
-							commandByte,
-							1,
-							payloadByte,
-							1,
-							gWarpI2cTimeoutMilliseconds);
-	if (returnValue != kStatus_I2C_Success)
-	{
-		return kWarpStatusDeviceCommunicationFailed;
-	}
-
-	return kWarpStatusOK;
+	return warpRegmapWrite(&regmapAMG8834, &deviceAMG8834State, deviceRegister, payload);
 }
 
 WarpStatus
@@ -136,39 +112,7 @@ configureSensorAMG8834(uint8_t payloadConfigReg, uint8_t payloadFrameRateReg, ui
 WarpStatus
 readSensorRegisterAMG8834(uint8_t deviceRegister, int numberOfBytes)
 {
-	uint8_t 	cmdBuf[1]	= {0xFF};
-	i2c_status_t	status;
-
-
-	USED(numberOfBytes);
-	if (deviceRegister > 0xFF)
-	{
-		return kWarpStatusBadDeviceCommand;
-	}
-
-	i2c_device_t slave =
-	{
-		.address = deviceAMG8834State.i2cAddress,
-		.baudRate_kbps = gWarpI2cBaudRateKbps
-	};
-
-	cmdBuf[0] = deviceRegister;
-
-	status = I2C_DRV_MasterReceiveDataBlocking(
-							0 /* I2C peripheral instance */,
-							&slave,
-							cmdBuf,
-							1,
-							(uint8_t *)deviceAMG8834State.i2cBuffer,
-							numberOfBytes,
-							gWarpI2cTimeoutMilliseconds);
-
-	if (status != kStatus_I2C_Success)
-	{
-		return kWarpStatusDeviceCommunicationFailed;
-	}
-
-	return kWarpStatusOK;
+	return warpRegmapRead(&regmapAMG8834, &deviceAMG8834State, deviceRegister, numberOfBytes);
 }
 
 void
@@ -39,6 +39,7 @@
 
 */
 #include <stdlib.h>
+#include <string.h>
 
 #include "fsl_misc_utilities.h"
 #include "fsl_device_registers.h"
@@ -49,17 +50,38 @@
 #include "fsl_power_manager.h"
 #include "fsl_mcglite_hal.h"
 #include "fsl_port_hal.h"
+#include "fsl_tpm_driver.h"
+#include "fsl_interrupt_manager.h"
+#include "fsl_os_abstraction.h"
 
 #include "gpio_pins.h"
 #include "SEGGER_RTT.h"
 #include "warp.h"
+#include "devINA219.h"
 
 
 extern volatile WarpI2CDeviceState	deviceINA219State;
+extern volatile WarpINA219AcquisitionState	deviceINA219AcquisitionState;
 extern volatile uint32_t		gWarpI2cBaudRateKbps;
 extern volatile uint32_t		gWarpI2cTimeoutMilliseconds;
 extern volatile uint32_t		gWarpSupplySettlingDelayMilliseconds;
 
+/*
+ *	Registers 0x00-0x05 can be read; only configuration (0x00) and
+ *	calibration (0x05) can be written. The pointer does not auto-increment.
+ */
+static const uint32_t	readableRegistersINA219[] = {0x0000003F};
+static const uint32_t	writableRegistersINA219[] = {0x00000021};
+
+static const WarpRegmap	regmapINA219 =
+{
+	.registerCount	= 6,
+	.registerBytes	= 2,
+	.flags		= kWarpRegmapFlagBigEndian,
+	.readable	= readableRegistersINA219,
+	.writable	= writableRegistersINA219,
+};
+
 
 
 void
@@ -75,263 +97,952 @@ initINA219(const uint8_t i2cAddress, WarpI2CDeviceState volatile *  deviceStateP
 }
 
 WarpStatus
-writeSensorRegisterINA219(uint8_t deviceRegister, uint8_t payload, uint16_t menuI2cPullupValue)
+writeSensorRegisterDeviceINA219(WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t deviceRegister, uint16_t payload)
+{
+	return warpRegmapWrite(&regmapINA219, deviceStatePointer, deviceRegister, payload);
+}
+
+WarpStatus
+writeSensorRegisterINA219(uint8_t deviceRegister, uint16_t payload, uint16_t menuI2cPullupValue)
+{
+	return writeSensorRegisterDeviceINA219(&deviceINA219State, deviceRegister, payload);
+}
+
+WarpStatus
+configureSensorDeviceINA219(WarpI2CDeviceState volatile *  deviceStatePointer, uint16_t payloadConfiguration, uint16_t payloadCalibration)
 {
-	uint8_t		payloadByte[2], commandByte[1];
-	i2c_status_t	status;
+	WarpStatus	i2cWriteStatus1;
+	WarpStatus	i2cWriteStatus2;
 
-	switch (deviceRegister)
+	i2cWriteStatus1 = writeSensorRegisterDeviceINA219(deviceStatePointer,
+							kWarpINA219RegisterConfiguration,
+							payloadConfiguration);
+
+	i2cWriteStatus2 = writeSensorRegisterDeviceINA219(deviceStatePointer,
+							kWarpINA219RegisterCalibration,
+							payloadCalibration);
+
+	return (i2cWriteStatus1 | i2cWriteStatus2);
+}
+
+/*
+ *	Configures the default device, and limits the acquisition engine to
+ *	its conversion rate.
+ */
+WarpStatus
+configureSensorINA219(uint16_t payloadConfiguration, uint16_t payloadCalibration, uint16_t menuI2cPullupValue)
+{
+	deviceINA219AcquisitionState.conversionMicroseconds = getConversionMicrosecondsINA219(payloadConfiguration);
+
+	return configureSensorDeviceINA219(&deviceINA219State, payloadConfiguration, payloadCalibration);
+}
+
+uint16_t
+getProfileConfigurationINA219(const WarpINA219Profile *  profile)
+{
+	return	(profile->busRange << kWarpINA219ConfigurationBusRangeShift) |
+		(profile->gain << kWarpINA219ConfigurationGainShift) |
+		(profile->busAdc << kWarpINA219ConfigurationBusAdcShift) |
+		(profile->shuntAdc << kWarpINA219ConfigurationShuntAdcShift) |
+		(profile->mode << kWarpINA219ConfigurationModeShift);
+}
+
+WarpStatus
+configureProfileINA219(const WarpINA219Profile *  profile, uint16_t menuI2cPullupValue)
+{
+	return configureSensorINA219(getProfileConfigurationINA219(profile), profile->calibration, menuI2cPullupValue);
+}
+
+/*
+ *	The configuration register holds still between reads, so it serves as
+ *	the probe for bus speed tuning.
+ */
+WarpStatus
+tuneI2cSpeedDeviceINA219(WarpI2CDeviceState volatile *  deviceStatePointer)
+{
+	return warpRegmapTuneSpeed(&regmapINA219, deviceStatePointer, kWarpINA219RegisterConfiguration, kWarpI2CTuneReadsPerSpeed);
+}
+
+WarpStatus
+tuneI2cSpeedINA219(uint16_t menuI2cPullupValue)
+{
+	return tuneI2cSpeedDeviceINA219(&deviceINA219State);
+}
+
+/*
+ *	Time for one result under the given configuration word, from the
+ *	conversion times in the INA219 datasheet. In the shunt-and-bus modes the
+ *	two conversions run back to back and CNVR is set after the second.
+ */
+static uint32_t
+adcConversionMicrosecondsINA219(uint8_t adcSetting)
+{
+	/*
+	 *	0x0-0x7: single conversion, resolution from the low two bits.
+	 *	0x8-0xF: 2^(setting - 8) averaged 12-bit conversions.
+	 */
+	static const uint32_t	singleConversionMicroseconds[] = {84, 148, 276, 532};
+	static const uint32_t	averagedConversionMicroseconds[] = {532, 1060, 2130, 4260, 8510, 17020, 34050, 68100};
+
+	if (adcSetting & 0x8)
 	{
-		case 0x00: case 0x05:
+		return averagedConversionMicroseconds[adcSetting & 0x7];
+	}
+
+	return singleConversionMicroseconds[adcSetting & 0x3];
+}
+
+uint32_t
+getConversionMicrosecondsINA219(uint16_t configuration)
+{
+	uint8_t		mode = (configuration >> kWarpINA219ConfigurationModeShift) & kWarpINA219ConfigurationModeMask;
+	uint32_t	busMicroseconds = adcConversionMicrosecondsINA219((configuration >> kWarpINA219ConfigurationBusAdcShift) & kWarpINA219ConfigurationAdcMask);
+	uint32_t	shuntMicroseconds = adcConversionMicrosecondsINA219((configuration >> kWarpINA219ConfigurationShuntAdcShift) & kWarpINA219ConfigurationAdcMask);
+
+	switch (mode)
+	{
+		case kWarpINA219ModeShuntTriggered:
+		case kWarpINA219ModeShuntContinuous:
 		{
-			/* OK */
-			break;
+			return shuntMicroseconds;
 		}
-		
+
+		case kWarpINA219ModeBusTriggered:
+		case kWarpINA219ModeBusContinuous:
+		{
+			return busMicroseconds;
+		}
+
+		case kWarpINA219ModeShuntAndBusTriggered:
+		case kWarpINA219ModeShuntAndBusContinuous:
+		{
+			return shuntMicroseconds + busMicroseconds;
+		}
+
 		default:
 		{
-			return kWarpStatusBadDeviceCommand;
+			return 0;
 		}
 	}
+}
+
+/*
+ *	Poll the conversion-ready (CNVR) flag, up to maxPolls reads of the bus
+ *	voltage register, then read the shunt voltage and clear CNVR by reading
+ *	the power register. Returns kWarpStatusConversionNotReady if no new
+ *	conversion completed, so the caller never sees the same result twice.
+ */
+WarpStatus
+readConversionDeviceINA219(WarpI2CDeviceState volatile *  deviceStatePointer, int16_t *  shuntVoltage, uint32_t maxPolls)
+{
+	WarpStatus	status;
+	uint32_t	polls = 0;
 
-	i2c_device_t slave =
+	do
 	{
-		.address = deviceINA219State.i2cAddress,
-		.baudRate_kbps = gWarpI2cBaudRateKbps
-	};
+		if (polls++ == maxPolls)
+		{
+			return kWarpStatusConversionNotReady;
+		}
 
-	commandByte[0] = deviceRegister;
-	// Modified to accept a two byte payload
-	payloadByte[0] = (payload & 0xFF00) >> 8;
-	payloadByte[1] = (payload & 0x00FF);
-	status = I2C_DRV_MasterSendDataBlocking(
-							0 /* I2C instance */,
-							&slave,
-							commandByte,
-							1, // kept at one byte for memory address
-							payloadByte,
-							2, // Changed to 2 bytes for payload
-							gWarpI2cTimeoutMilliseconds);
-	if (status != kStatus_I2C_Success)
+		status = readSensorRegisterDeviceINA219(deviceStatePointer, kWarpINA219RegisterBusVoltage, 2 /* numberOfBytes */);
+		if (status != kWarpStatusOK)
+		{
+			return status;
+		}
+	} while (!(deviceStatePointer->i2cBuffer[1] & kWarpINA219BusVoltageConversionReadyBit));
+
+	status = readSensorRegisterDeviceINA219(deviceStatePointer, kWarpINA219RegisterShuntVoltage, 2 /* numberOfBytes */);
+	if (status != kWarpStatusOK)
 	{
-		return kWarpStatusDeviceCommunicationFailed;
+		return status;
 	}
 
-	return kWarpStatusOK;
+	*shuntVoltage = (int16_t)warpRegmapGetValue(&regmapINA219, deviceStatePointer, 0);
+
+	return readSensorRegisterDeviceINA219(deviceStatePointer, kWarpINA219RegisterPower, 2 /* numberOfBytes */);
 }
 
 WarpStatus
-configureSensorINA219(uint8_t payloadF_SETUP, uint16_t menuI2cPullupValue)
+readConversionINA219(int16_t *  shuntVoltage, uint32_t maxPolls)
 {
-	WarpStatus	i2cWriteStatus1;
-	WarpStatus	i2cWriteStatus2;
+	return readConversionDeviceINA219(&deviceINA219State, shuntVoltage, maxPolls);
+}
 
-	/*
-	Chosen to remove writing as setting incorrect register values (only sending one byte) and default settings are correct
-	i2cWriteStatus1 = writeSensorRegisterINA219(0x00, // config address
-						    0b0011100110011111, // payload: Set voltage gain
-							menuI2cPullupValue);
+WarpStatus
+readSensorRegisterDeviceINA219(WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t deviceRegister, int numberOfBytes)
+{
+	return warpRegmapRead(&regmapINA219, deviceStatePointer, deviceRegister, numberOfBytes);
+}
 
-	i2cWriteStatus2 = writeSensorRegisterINA219(0x05, // config address,
-						    0b0101000000000000, // payload: Set up current config register 
-							     // Set here for easy access rather than in boot.c
-							menuI2cPullupValue);
-	*/
+WarpStatus
+readSensorRegisterINA219(uint8_t deviceRegister, int numberOfBytes)
+{
+	return readSensorRegisterDeviceINA219(&deviceINA219State, deviceRegister, numberOfBytes);
+}
 
-	return (i2cWriteStatus1 | i2cWriteStatus2);
+/*
+ *	With the bus voltage register (CNVR set) in i2cBuffer, read the rest of
+ *	the conversion. The three reads are queued together, so the I2C
+ *	interrupt runs them back to back while the core waits in WAIT. The
+ *	power read comes last and clears CNVR.
+ */
+static WarpStatus
+readConversionRegistersINA219(WarpI2CDeviceState volatile *  deviceStatePointer, WarpINA219Snapshot *  snapshot)
+{
+	static const uint8_t	conversionRegisters[] =
+	{
+		kWarpINA219RegisterShuntVoltage,
+		kWarpINA219RegisterCurrent,
+		kWarpINA219RegisterPower,
+	};
+	WarpI2CTransaction	transactions[3];
+	uint8_t			values[3][2];
+	uint16_t		busRegister;
+	WarpStatus		status;
+
+
+	busRegister = warpRegmapGetValue(&regmapINA219, deviceStatePointer, 0);
+	snapshot->busVoltage	= busRegister >> 3;
+	snapshot->mathOverflow	= (busRegister & kWarpINA219BusVoltageOverflowBit) != 0;
+
+	snapshot->transactionCount += 3;
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		transactions[i].deviceStatePointer	= deviceStatePointer;
+		transactions[i].deviceRegister		= conversionRegisters[i];
+		transactions[i].direction		= kWarpI2CTransactionRead;
+		transactions[i].buffer			= values[i];
+		transactions[i].length			= 2;
+		transactions[i].callback		= NULL;
+
+		status = warpI2CQueueSubmit(&transactions[i]);
+		if (status != kWarpStatusOK)
+		{
+			warpI2CQueueWait(kWarpI2CQueueWaitTimeoutMilliseconds);
+
+			return status;
+		}
+	}
+
+	status = warpI2CQueueWait(kWarpI2CQueueWaitTimeoutMilliseconds);
+	if (status != kWarpStatusOK)
+	{
+		return status;
+	}
+
+	snapshot->shuntVoltage	= (int16_t)((values[0][0] << 8) | values[0][1]);
+	snapshot->current	= (int16_t)((values[1][0] << 8) | values[1][1]);
+	snapshot->power		= (values[2][0] << 8) | values[2][1];
+
+	return transactions[0].status | transactions[1].status | transactions[2].status;
 }
 
+/*
+ *	Take shunt, bus, current and power from the same conversion.
+ *
+ *	The INA219 does not auto-increment its register pointer, so each
+ *	register needs its own pointer write. Polling is the exception: once
+ *	the pointer is at the bus register, CNVR can be polled with plain reads.
+ *
+ *	CNVR is first seen clear (clearing it via the power register if it was
+ *	already set, since it could then be arbitrarily old), then polled until
+ *	it sets. The rest of the registers are read straight after, well inside
+ *	the next conversion time, and the power read last clears CNVR again.
+ */
 WarpStatus
-readSensorRegisterINA219(uint8_t deviceRegister, int numberOfBytes)
+readSnapshotDeviceINA219(WarpI2CDeviceState volatile *  deviceStatePointer, WarpINA219Snapshot *  snapshot)
 {
-	uint8_t		cmdBuf[1] = {0xFF};
-	i2c_status_t	status;
+	uint64_t	startMicroseconds = OSA_TimeGetUsec();
+	uint32_t	polls;
+	WarpStatus	status;
+
 
+	snapshot->transactionCount = 1;
+	status = readSensorRegisterDeviceINA219(deviceStatePointer, kWarpINA219RegisterBusVoltage, 2 /* numberOfBytes */);
+	if (status != kWarpStatusOK)
+	{
+		return status;
+	}
 
-	// Just ensures the vairable is used in the function
-	USED(numberOfBytes);
-	switch (deviceRegister)
+	if (deviceStatePointer->i2cBuffer[1] & kWarpINA219BusVoltageConversionReadyBit)
 	{
-		case 0x00: case 0x01: case 0x02: case 0x03: 
-		case 0x04: case 0x05:
+		snapshot->transactionCount += 2;
+		if ((readSensorRegisterDeviceINA219(deviceStatePointer, kWarpINA219RegisterPower, 2 /* numberOfBytes */) != kWarpStatusOK) ||
+			(readSensorRegisterDeviceINA219(deviceStatePointer, kWarpINA219RegisterBusVoltage, 2 /* numberOfBytes */) != kWarpStatusOK))
 		{
-			/* OK */
-			break;
+			return kWarpStatusDeviceCommunicationFailed;
 		}
-		
-		default:
+	}
+
+	for (polls = 0; !(deviceStatePointer->i2cBuffer[1] & kWarpINA219BusVoltageConversionReadyBit); polls++)
+	{
+		if (polls == kWarpINA219ConversionMaxPolls)
 		{
-			return kWarpStatusBadDeviceCommand;
+			return kWarpStatusConversionNotReady;
+		}
+
+		snapshot->transactionCount++;
+		status = warpRegmapReadAgain(&regmapINA219, deviceStatePointer, 2 /* numberOfBytes */);
+		if (status != kWarpStatusOK)
+		{
+			return status;
 		}
 	}
 
+	status = readConversionRegistersINA219(deviceStatePointer, snapshot);
 
-	i2c_device_t slave =
-	{
-		.address = deviceINA219State.i2cAddress,
-		.baudRate_kbps = gWarpI2cBaudRateKbps
-	};
+	snapshot->elapsedMicroseconds = OSA_TimeGetUsec() - startMicroseconds;
 
+	return status;
+}
 
-	cmdBuf[0] = deviceRegister;
+WarpStatus
+readSnapshotINA219(WarpINA219Snapshot *  snapshot)
+{
+	return readSnapshotDeviceINA219(&deviceINA219State, snapshot);
+}
 
-	status = I2C_DRV_MasterReceiveDataBlocking(
-							0 /* I2C peripheral instance */,
-							&slave,
-							cmdBuf,
-							1,
-							(uint8_t *)deviceINA219State.i2cBuffer,
-							numberOfBytes,
-							gWarpI2cTimeoutMilliseconds);
+WarpStatus
+initDeviceINA219(WarpINA219Device *  device, uint8_t i2cAddress)
+{
+	memset(device, 0, sizeof(WarpINA219Device));
 
-	if (status != kStatus_I2C_Success)
+	/*
+	 *	A0 and A1 each strap to GND, VS+, SDA or SCL, giving 0x40 to 0x4F.
+	 */
+	if ((i2cAddress < kWarpINA219BaseAddress) || (i2cAddress >= kWarpINA219BaseAddress + kWarpINA219MaxChannels))
 	{
-		return kWarpStatusDeviceCommunicationFailed;
+		return kWarpStatusBadDeviceCommand;
 	}
 
+	initINA219(i2cAddress, &device->i2c);
+
 	return kWarpStatusOK;
 }
 
+WarpStatus
+configureProfileDeviceINA219(WarpINA219Device *  device, const WarpINA219Profile *  profile)
+{
+	uint16_t	configuration = getProfileConfigurationINA219(profile);
+
+
+	device->conversionMicroseconds = getConversionMicrosecondsINA219(configuration);
+
+	return configureSensorDeviceINA219(&device->i2c, configuration, profile->calibration);
+}
+
 void
-printSensorDataINA219(bool hexModeFlag)
+initSchedulerINA219(WarpINA219Scheduler *  scheduler, WarpINA219Device *  devices, uint8_t deviceCount)
 {
-	uint16_t	readSensorRegisterValueLSB;
-	uint16_t	readSensorRegisterValueMSB;
-	int16_t		readSensorRegisterCombined;
-	WarpStatus	i2cReadStatus;
+	uint64_t	nowMicroseconds = OSA_TimeGetUsec();
+
+
+	scheduler->devices	= devices;
+	scheduler->deviceCount	= deviceCount;
+	scheduler->next		= 0;
+
+	/*
+	 *	A channel's first snapshot then covers the time since it joined,
+	 *	rather than the time since boot.
+	 */
+	for (uint8_t i = 0; i < deviceCount; i++)
+	{
+		devices[i].lastSnapshotMicroseconds = nowMicroseconds;
+	}
+}
+
+/*
+ *	Visit the next channel in turn. Channels in a continuous mode convert in
+ *	parallel, so rather than block on one device's CNVR the scheduler takes
+ *	one look at it and moves on: a ready device costs four transactions
+ *	(bus, shunt, current, power), one that isn't costs one. Each call
+ *	touches exactly one channel, keeping the bus time per call bounded.
+ *
+ *	Returns the index of the channel that produced a new snapshot, or
+ *	kWarpINA219MaxChannels if none did.
+ */
+uint8_t
+serviceSchedulerINA219(WarpINA219Scheduler *  scheduler)
+{
+	WarpINA219Device *	device;
+	uint8_t			channel;
+	uint64_t		nowMicroseconds;
+	WarpStatus		status;
+
+
+	if (scheduler->deviceCount == 0)
+	{
+		return kWarpINA219MaxChannels;
+	}
 
+	channel = scheduler->next;
+	device = &scheduler->devices[channel];
+	scheduler->next = (channel + 1) % scheduler->deviceCount;
 
-	// 0x01 is the shunt voltage register 
-	i2cReadStatus = readSensorRegisterINA219(0x01, 2 /* numberOfBytes */);
+	device->snapshot.transactionCount = 1;
+	status = readSensorRegisterDeviceINA219(&device->i2c, kWarpINA219RegisterBusVoltage, 2 /* numberOfBytes */);
+	if (status != kWarpStatusOK)
+	{
+		device->failedCount++;
 
-	readSensorRegisterValueMSB = deviceINA219State.i2cBuffer[0];
-	readSensorRegisterValueLSB = deviceINA219State.i2cBuffer[1];
+		return kWarpINA219MaxChannels;
+	}
 
-	readSensorRegisterCombined = ((readSensorRegisterValueMSB) << 8) | (readSensorRegisterValueLSB & 0xFF);
+	if (!(device->i2c.i2cBuffer[1] & kWarpINA219BusVoltageConversionReadyBit))
+	{
+		device->notReadyCount++;
 
+		return kWarpINA219MaxChannels;
+	}
+
+	status = readConversionRegistersINA219(&device->i2c, &device->snapshot);
+	if (status != kWarpStatusOK)
+	{
+		device->failedCount++;
+
+		return kWarpINA219MaxChannels;
+	}
+
+	nowMicroseconds = OSA_TimeGetUsec();
+	device->snapshot.elapsedMicroseconds = nowMicroseconds - device->lastSnapshotMicroseconds;
+	device->lastSnapshotMicroseconds = nowMicroseconds;
+	device->snapshotCount++;
+
+	return channel;
+}
+
+void
+printSensorDataINA219(bool hexModeFlag)
+{
+	WarpINA219Snapshot	snapshot;
+	WarpStatus		i2cReadStatus;
+
+
+	/*
+	 *	All four values come from the same conversion, so shunt/bus and
+	 *	current/power pair up.
+	 */
+	i2cReadStatus = readSnapshotINA219(&snapshot);
 
 	if (i2cReadStatus != kWarpStatusOK)
 	{
-		SEGGER_RTT_WriteString(0, " ----,");
+		SEGGER_RTT_WriteString(0, " ----, ----, ----, ----, ----, ----,");
 	}
 	else
 	{
 		if (hexModeFlag)
 		{
-			SEGGER_RTT_printf(0, " 0x%02x 0x%02x,", readSensorRegisterValueMSB, readSensorRegisterValueLSB);
+			SEGGER_RTT_printf(0, " 0x%04x, 0x%04x, 0x%04x, 0x%04x,",
+						(uint16_t)snapshot.shuntVoltage,
+						snapshot.busVoltage,
+						(uint16_t)snapshot.current,
+						snapshot.power);
 		}
 		else
 		{
-			SEGGER_RTT_printf(0, " %d,", readSensorRegisterCombined);
+			SEGGER_RTT_printf(0, " %d, %u, %d, %u,",
+						snapshot.shuntVoltage,
+						snapshot.busVoltage,
+						snapshot.current,
+						snapshot.power);
 		}
+
+		SEGGER_RTT_printf(0, " %u, %u,", snapshot.transactionCount, snapshot.elapsedMicroseconds);
 	}
+}
 
 
-	// 0x02 is the bus voltage register 
-	i2cReadStatus = readSensorRegisterINA219(0x02, 2 /* numberOfBytes */);
+void
+repeatedReadSensorDataINA219(int *bufSample, int num_samples)
+{
+	int16_t		shuntVoltage;
+	int		missedReads = 0;
+	WarpStatus	i2cReadStatus;
 
-	readSensorRegisterValueMSB = deviceINA219State.i2cBuffer[0];
-	readSensorRegisterValueLSB = deviceINA219State.i2cBuffer[1];
 
-	readSensorRegisterCombined = ((readSensorRegisterValueMSB ) << 5) | ((readSensorRegisterValueLSB & 0b11111000) >> 3);
-	readSensorRegisterCombined = ((readSensorRegisterValueMSB) << 8) | (readSensorRegisterValueLSB & 0xFF);
+	for (int i = 0; i < num_samples; i++)
+	{
+		/*
+		 *	Wait for each new conversion rather than re-reading the shunt
+		 *	register faster than the INA219 updates it.
+		 */
+		i2cReadStatus = readConversionINA219(&shuntVoltage, kWarpINA219ConversionMaxPolls);
+
+		/*
+		 *	The retry policy (and bus recovery) has already had its go
+		 *	at a failed read. Repeat the previous sample, as the
+		 *	acquisition ISR does, so the window keeps its length and
+		 *	spacing instead of stalling.
+		 */
+		if (i2cReadStatus != kWarpStatusOK)
+		{
+			missedReads++;
+			shuntVoltage = (i > 0) ? bufSample[i - 1] : 0;
+		}
 
-	if (i2cReadStatus != kWarpStatusOK)
+		bufSample[i] = shuntVoltage;
+	}
+
+	if (missedReads > 0)
 	{
-		SEGGER_RTT_WriteString(0, " ----,");
+		SEGGER_RTT_printf(0, " Missed %d Reads on I2C", missedReads);
 	}
-	else
+}
+
+
+/*
+ *	Timer-driven acquisition engine.
+ *
+ *	TPM0 overflows once per sample period and its ISR reads one conversion
+ *	into the current ping/pong window. Sample spacing is
+ *	therefore set by the timer rather than by how long the rest of the main
+ *	loop takes, and main() can process (and draw) one window while the other
+ *	fills.
+ *
+ *	While the engine is running it owns deviceINA219State and the I2C bus;
+ *	main() must not issue other I2C transfers until stopAcquisitionINA219().
+ */
+WarpStatus
+startAcquisitionINA219(uint32_t samplePeriodMicroseconds)
+{
+	volatile WarpINA219AcquisitionState *	acquisition = &deviceINA219AcquisitionState;
+	tpm_general_config_t			tpmConfig;
+	uint32_t				timerFrequency;
+	uint32_t				timerTicks;
+	uint32_t				busMicroseconds;
+	uint32_t				baudRateKbps;
+	uint8_t					prescaler;
+
+
+	/*
+	 *	Sampling faster than the INA219 converts would find CNVR clear, and
+	 *	every window that hits a clear CNVR is thrown away.
+	 */
+	if (samplePeriodMicroseconds < (acquisition->conversionMicroseconds * (100 + kWarpINA219ConversionMarginPercent)) / 100)
 	{
-		if (hexModeFlag)
+		samplePeriodMicroseconds = (acquisition->conversionMicroseconds * (100 + kWarpINA219ConversionMarginPercent)) / 100;
+	}
+
+	/*
+	 *	Nor can the ISR's reads be allowed to fill the period (at 200kHz
+	 *	they take about 700us), or main() is starved and periods are missed
+	 *	outright. Stretch the period until they fit in their share of it.
+	 */
+	baudRateKbps	= (deviceINA219State.speed.baudRateKbps != 0) ? deviceINA219State.speed.baudRateKbps : gWarpI2cBaudRateKbps;
+	busMicroseconds	= (kWarpINA219ConversionReads * kWarpINA219ConversionReadBits * 1000) / baudRateKbps;
+
+	if (samplePeriodMicroseconds < (busMicroseconds * 100) / kWarpINA219AcquisitionBusPercent)
+	{
+		samplePeriodMicroseconds = (busMicroseconds * 100) / kWarpINA219AcquisitionBusPercent;
+	}
+
+	tpmConfig.isDBGMode		= true;
+	tpmConfig.isGlobalTimeBase	= false;
+	tpmConfig.isTriggerMode		= false;
+	tpmConfig.isStopCountOnOveflow	= false;
+	tpmConfig.isCountReloadOnTrig	= false;
+	tpmConfig.triggerSource		= kTpmExtTrig;
+
+	TPM_DRV_Init(kWarpINA219AcquisitionTimerInstance, &tpmConfig);
+
+	/*
+	 *	Pick the smallest prescaler that fits the period into the 16-bit
+	 *	modulo register, so the period is quantised as finely as possible.
+	 */
+	for (prescaler = kTpmDividedBy1; prescaler <= kTpmDividedBy128; prescaler++)
+	{
+		TPM_DRV_SetClock(kWarpINA219AcquisitionTimerInstance, kTpmClockSourceModuleMCGIRCLK, (tpm_clock_ps_t)prescaler);
+		timerFrequency = TPM_DRV_GetClock(kWarpINA219AcquisitionTimerInstance);
+		timerTicks = (uint32_t)(((uint64_t)timerFrequency * samplePeriodMicroseconds) / 1000000);
+
+		if (timerTicks <= 0xFFFF)
 		{
-			SEGGER_RTT_printf(0, " 0x%02x 0x%02x,", readSensorRegisterValueMSB, readSensorRegisterValueLSB);
+			break;
 		}
-		else
+	}
+
+	if ((timerTicks == 0) || (timerTicks > 0xFFFF))
+	{
+		TPM_DRV_Deinit(kWarpINA219AcquisitionTimerInstance);
+
+		return kWarpStatusBadDeviceCommand;
+	}
+
+	acquisition->fillWindow			= 0;
+	acquisition->fillIndex			= 0;
+	acquisition->readyMask			= 0;
+	acquisition->gapMask			= 0;
+	acquisition->gapPending			= true;
+	acquisition->windowsCompleted		= 0;
+	acquisition->windowsDropped		= 0;
+	acquisition->readsFailed		= 0;
+	acquisition->conversionsNotReady	= 0;
+	acquisition->windowsFailed		= 0;
+	acquisition->samplesDiscarded		= 0;
+	acquisition->periodsMissed		= 0;
+	acquisition->lastEntryMilliseconds	= OSA_TimeGetMsec();
+	acquisition->maxLatencyTicks		= 0;
+	acquisition->timerTicksPerSample	= timerTicks;
+	acquisition->samplePeriodMicroseconds	= (uint32_t)(((uint64_t)timerTicks * 1000000) / timerFrequency);
+	acquisition->running			= true;
+
+	NVIC_SetPriority(TPM0_IRQn, kWarpINA219AcquisitionIrqPriority);
+	TPM_DRV_CounterStart(kWarpINA219AcquisitionTimerInstance, kTpmCountingUp, timerTicks - 1, true /* enableOverflowInt */);
+
+	return kWarpStatusOK;
+}
+
+void
+stopAcquisitionINA219(void)
+{
+	TPM_DRV_CounterStop(kWarpINA219AcquisitionTimerInstance);
+	TPM_DRV_Deinit(kWarpINA219AcquisitionTimerInstance);
+	deviceINA219AcquisitionState.running = false;
+}
+
+/*
+ *	Returns the window main() should process next, or NULL if neither window
+ *	is full yet. The window stays owned by main() until releaseWindowINA219().
+ */
+volatile int16_t *
+getReadyWindowINA219(void)
+{
+	volatile WarpINA219AcquisitionState *	acquisition = &deviceINA219AcquisitionState;
+
+	for (uint8_t window = 0; window < kWarpINA219AcquisitionWindowCount; window++)
+	{
+		if (acquisition->readyMask & (1 << window))
 		{
-			SEGGER_RTT_printf(0, " %d,", readSensorRegisterCombined);
+			return acquisition->samples[window];
 		}
 	}
 
-	// 0x04 is the current register 
-	i2cReadStatus = readSensorRegisterINA219(0x04, 2 /* numberOfBytes */);
-
-	readSensorRegisterValueMSB = deviceINA219State.i2cBuffer[0];
-	readSensorRegisterValueLSB = deviceINA219State.i2cBuffer[1];
+	return NULL;
+}
 
-	readSensorRegisterCombined = ((readSensorRegisterValueMSB & 0b01111111) << 8) | readSensorRegisterValueLSB;
+/*
+ *	Copies out the statistics of the window getReadyWindowINA219() would return.
+ */
+bool
+getReadyStatisticsINA219(WarpStatisticsAccumulator *  statistics)
+{
+	volatile WarpINA219AcquisitionState *	acquisition = &deviceINA219AcquisitionState;
 
-	if (i2cReadStatus != kWarpStatusOK)
+	for (uint8_t window = 0; window < kWarpINA219AcquisitionWindowCount; window++)
 	{
-		SEGGER_RTT_WriteString(0, " ----,");
+		if (acquisition->readyMask & (1 << window))
+		{
+			*statistics = acquisition->statistics[window];
+
+			return true;
+		}
 	}
-	else
+
+	return false;
+}
+
+/*
+ *	Whether the window getReadyWindowINA219() would return follows on from
+ *	the one before it with no periods lost in between. The first window
+ *	after startAcquisitionINA219() never does.
+ */
+bool
+getReadyWindowContiguousINA219(void)
+{
+	volatile WarpINA219AcquisitionState *	acquisition = &deviceINA219AcquisitionState;
+
+	for (uint8_t window = 0; window < kWarpINA219AcquisitionWindowCount; window++)
 	{
-		if (hexModeFlag)
+		if (acquisition->readyMask & (1 << window))
 		{
-			SEGGER_RTT_printf(0, " 0x%02x 0x%02x,", readSensorRegisterValueMSB, readSensorRegisterValueLSB);
+			return !(acquisition->gapMask & (1 << window));
 		}
-		else
+	}
+
+	return false;
+}
+
+void
+releaseWindowINA219(void)
+{
+	INT_SYS_DisableIRQGlobal();
+	deviceINA219AcquisitionState.readyMask = 0;
+	INT_SYS_EnableIRQGlobal();
+}
+
+/*
+ *	Arm (or re-arm) transient capture. Safe to call while acquisition runs.
+ *	postTriggerSamples is clamped to the ring space left after the
+ *	pre-trigger samples and the trigger sample; with 0, the capture
+ *	freezes on the trigger sample itself.
+ */
+void
+armTransientCaptureINA219(uint16_t levelThreshold, uint16_t slopeThreshold, uint8_t preTriggerSamples, uint8_t postTriggerSamples)
+{
+	volatile WarpINA219TransientCapture *	transient = &deviceINA219AcquisitionState.transient;
+
+	preTriggerSamples = min(preTriggerSamples, kWarpINA219TransientSamples - 1);
+
+	INT_SYS_DisableIRQGlobal();
+	transient->levelThreshold	= levelThreshold;
+	transient->slopeThreshold	= slopeThreshold;
+	transient->preTriggerSamples	= preTriggerSamples;
+	transient->postTriggerSamples	= min(postTriggerSamples, kWarpINA219TransientSamples - 1 - preTriggerSamples);
+	transient->filled		= 0;
+	transient->cause		= 0;
+	transient->state		= kWarpINA219TransientArmed;
+	INT_SYS_EnableIRQGlobal();
+}
+
+/*
+ *	Called from the TPM0 ISR for every sample.
+ */
+static void
+transientAddSampleINA219(volatile WarpINA219TransientCapture *  transient, int16_t sample)
+{
+	uint8_t		cause = 0;
+
+	if ((transient->state == kWarpINA219TransientDisarmed) || (transient->state == kWarpINA219TransientFrozen))
+	{
+		return;
+	}
+
+	transient->samples[transient->writeIndex] = sample;
+	transient->writeIndex = (transient->writeIndex + 1) % kWarpINA219TransientSamples;
+
+	if (transient->state == kWarpINA219TransientCapturing)
+	{
+		if (--transient->postTriggerRemaining == 0)
 		{
-			SEGGER_RTT_printf(0, " %d,", readSensorRegisterCombined);
+			transient->state = kWarpINA219TransientFrozen;
 		}
+
+		return;
+	}
+
+	/*
+	 *	Don't trigger until there are enough samples for the pre-trigger
+	 *	history, or the capture would start with stale data.
+	 */
+	if (transient->filled < transient->preTriggerSamples)
+	{
+		transient->filled++;
+		transient->previousSample = sample;
+
+		return;
+	}
+
+	if ((transient->levelThreshold != 0) && (abs(sample) >= transient->levelThreshold))
+	{
+		cause |= kWarpINA219TransientCauseLevel;
+	}
+
+	if ((transient->slopeThreshold != 0) && (abs(sample - transient->previousSample) >= transient->slopeThreshold))
+	{
+		cause |= kWarpINA219TransientCauseSlope;
 	}
 
+	transient->previousSample = sample;
 
+	if (cause != 0)
+	{
+		transient->cause		= cause;
+		transient->triggerWindow	= deviceINA219AcquisitionState.windowsCompleted;
+		transient->captureCount++;
+		transient->postTriggerRemaining	= transient->postTriggerSamples;
+		transient->state		= (transient->postTriggerRemaining == 0) ? kWarpINA219TransientFrozen : kWarpINA219TransientCapturing;
+	}
+}
+
+/*
+ *	If a capture is frozen, stream it over RTT and re-arm. The ISR does not
+ *	touch a frozen capture, so acquisition carries on while this prints.
+ */
+bool
+printTransientCaptureINA219(void)
+{
+	volatile WarpINA219TransientCapture *	transient = &deviceINA219AcquisitionState.transient;
+	uint8_t					captureSamples;
+	uint8_t					firstIndex;
 
+	if (transient->state != kWarpINA219TransientFrozen)
+	{
+		return false;
+	}
+
+	SEGGER_RTT_printf(0, "Transient %u: cause 0x%x, window %u, %u pre-trigger, %u post-trigger samples\n",
+				transient->captureCount,
+				transient->cause,
+				transient->triggerWindow,
+				transient->preTriggerSamples,
+				transient->postTriggerSamples);
+
+	/*
+	 *	The capture is the newest samples in the ring, ending at writeIndex.
+	 */
+	captureSamples	= transient->preTriggerSamples + 1 + transient->postTriggerSamples;
+	firstIndex	= (transient->writeIndex + kWarpINA219TransientSamples - captureSamples) % kWarpINA219TransientSamples;
+
+	for (uint8_t i = 0; i < captureSamples; i++)
+	{
+		SEGGER_RTT_printf(0, "%d,", transient->samples[(firstIndex + i) % kWarpINA219TransientSamples]);
+	}
+	SEGGER_RTT_WriteString(0, "\n");
+
+	armTransientCaptureINA219(transient->levelThreshold, transient->slopeThreshold, transient->preTriggerSamples, transient->postTriggerSamples);
+
+	return true;
 }
 
+/*
+ *	A window with a period missing from it would no longer have even
+ *	spacing, which the cycle RMS and harmonic analysis both assume. Throw
+ *	away what there is of it and start again.
+ */
+static void
+discardPartialWindowINA219(void)
+{
+	volatile WarpINA219AcquisitionState *	acquisition = &deviceINA219AcquisitionState;
+
+	if (acquisition->fillIndex > 0)
+	{
+		acquisition->windowsFailed++;
+		acquisition->samplesDiscarded += acquisition->fillIndex;
+		acquisition->fillIndex = 0;
+	}
+	acquisition->gapPending = true;
+}
 
+/*
+ *	Account for sample periods in which the ISR never ran. Called from
+ *	TPM0_IRQHandler(), before the period it was entered for is sampled.
+ */
 void
-repeatedReadSensorDataINA219(int *bufSample, int num_samples)
+acquisitionMissedPeriodsINA219(uint32_t periods)
 {
+	deviceINA219AcquisitionState.periodsMissed += periods;
+	discardPartialWindowINA219();
+}
 
-	// Fill up the pointer to the sample buffer with samples
+/*
+ *	One sample period's work: read a conversion into the window being
+ *	filled, and hand the window to main() when it is full. Called from
+ *	TPM0_IRQHandler().
+ */
+void
+acquisitionSampleINA219(void)
+{
+	volatile WarpINA219AcquisitionState *	acquisition = &deviceINA219AcquisitionState;
+	uint8_t					otherWindow;
+	int16_t					sample;
 
+	/*
+	 *	A single CNVR poll: if the INA219 has no new result yet, skip this
+	 *	period rather than store a repeat of the last conversion. On a failed
+	 *	read, repeat the previous sample rather than retrying: a retry would
+	 *	shift every later sample in the window and break the fixed spacing.
+	 */
+	switch (readConversionINA219(&sample, 1 /* maxPolls */))
+	{
+		case kWarpStatusOK:
+		{
+			break;
+		}
 
-	uint16_t	readSensorRegisterValueLSB;
-	uint16_t	readSensorRegisterValueMSB;
-	int16_t		readSensorRegisterCombined;
-	int		missedReads = 0;
-	WarpStatus	i2cReadStatus;	
+		case kWarpStatusConversionNotReady:
+		{
+			acquisition->conversionsNotReady++;
+			discardPartialWindowINA219();
 
-	
+			return;
+		}
 
-	for(int i=0; i<num_samples; i++)
-    	{
-		if (missedReads > num_samples)
+		default:
 		{
-			// If I2C reads continue to fail break the loop
-			SEGGER_RTT_printf(0, " Missed %d Reads on I2C", missedReads);
-			break;
+			acquisition->readsFailed++;
+			sample = (acquisition->fillIndex > 0) ? acquisition->samples[acquisition->fillWindow][acquisition->fillIndex - 1] : 0;
 		}
-		// 0x01 is the shunt voltage register 
-		i2cReadStatus = readSensorRegisterINA219(0x01, 2 /* numberOfBytes */);
+	}
+
+	if (acquisition->fillIndex == 0)
+	{
+		warpStatisticsReset(&acquisition->statistics[acquisition->fillWindow]);
+	}
 
-		readSensorRegisterValueMSB = deviceINA219State.i2cBuffer[0];
-		readSensorRegisterValueLSB = deviceINA219State.i2cBuffer[1];
+	acquisition->samples[acquisition->fillWindow][acquisition->fillIndex++] = sample;
+	warpStatisticsAddSample(&acquisition->statistics[acquisition->fillWindow], sample);
+	transientAddSampleINA219(&acquisition->transient, sample);
 
-		readSensorRegisterCombined = ((readSensorRegisterValueMSB) << 8) | (readSensorRegisterValueLSB & 0xFF);
+	if (acquisition->fillIndex < kWarpSizesINA219WindowSamples)
+	{
+		return;
+	}
 
+	acquisition->fillIndex = 0;
+	otherWindow = acquisition->fillWindow ^ 1;
 
-		if (i2cReadStatus != kWarpStatusOK)
+	if (acquisition->readyMask & (1 << otherWindow))
+	{
+		/*
+		 *	main() still holds the other window, so there is nowhere to go:
+		 *	drop this one and refill it.
+		 */
+		acquisition->windowsDropped++;
+		acquisition->gapPending = true;
+	}
+	else
+	{
+		if (acquisition->gapPending)
 		{
-			// Poor read on I2C so run again in loop			
-			i--;
-			missedReads++;
+			acquisition->gapMask |= (1 << acquisition->fillWindow);
 		}
 		else
 		{
-			// Good read so store value
-			bufSample[i] = readSensorRegisterCombined;
-		}   
-		
-
-    	}
-
+			acquisition->gapMask &= ~(1 << acquisition->fillWindow);
+		}
+		acquisition->gapPending = false;
 
+		acquisition->readyMask |= (1 << acquisition->fillWindow);
+		acquisition->windowsCompleted++;
+		acquisition->fillWindow = otherWindow;
+	}
 }
 
+/*
+ *	Override the TPM0 IRQ handler (fsl_tpm_irq.c is not linked in).
+ */
+void
+TPM0_IRQHandler(void)
+{
+	volatile WarpINA219AcquisitionState *	acquisition = &deviceINA219AcquisitionState;
+	uint16_t				latencyTicks;
+	uint16_t				entryMilliseconds;
+	uint32_t				elapsedMicroseconds;
 
+	latencyTicks = TPM_HAL_GetCounterVal(TPM0_BASE);
+	TPM_HAL_ClearTimerOverflowFlag(TPM0_BASE);
+	entryMilliseconds = OSA_TimeGetMsec();
 
+	if (latencyTicks > acquisition->maxLatencyTicks)
+	{
+		acquisition->maxLatencyTicks = latencyTicks;
+	}
 
+	/*
+	 *	The millisecond count is only good to a count either way, so only
+	 *	act when more than one and a half periods have certainly gone by
+	 *	since the last entry, then round to the nearest whole period.
+	 *	The uint16_t difference copes with the counter wrapping.
+	 */
+	elapsedMicroseconds = (uint16_t)(entryMilliseconds - acquisition->lastEntryMilliseconds) * 1000;
+	acquisition->lastEntryMilliseconds = entryMilliseconds;
+
+	if (elapsedMicroseconds > 1000 + (acquisition->samplePeriodMicroseconds * 3) / 2)
+	{
+		acquisitionMissedPeriodsINA219((elapsedMicroseconds + acquisition->samplePeriodMicroseconds / 2) / acquisition->samplePeriodMicroseconds - 1);
+	}
 
+	acquisitionSampleINA219();
+}
@@ -39,15 +39,350 @@
 #define WARP_BUILD_ENABLE_DEVINA219
 #endif
 
+typedef enum
+{
+	kWarpINA219RegisterConfiguration	= 0x00,
+	kWarpINA219RegisterShuntVoltage		= 0x01,
+	kWarpINA219RegisterBusVoltage		= 0x02,
+	kWarpINA219RegisterPower		= 0x03,
+	kWarpINA219RegisterCurrent		= 0x04,
+	kWarpINA219RegisterCalibration		= 0x05,
+} WarpINA219Register;
+
+typedef enum
+{
+	kWarpINA219ConfigurationResetBit	= (1 << 15),
+	kWarpINA219ConfigurationBusRangeShift	= 13,
+	kWarpINA219ConfigurationGainShift	= 11,
+	kWarpINA219ConfigurationBusAdcShift	= 7,
+	kWarpINA219ConfigurationShuntAdcShift	= 3,
+	kWarpINA219ConfigurationModeShift	= 0,
+	kWarpINA219ConfigurationAdcMask		= 0xF,
+	kWarpINA219ConfigurationModeMask	= 0x7,
+
+	/*
+	 *	Status bits in the low end of the bus voltage register. CNVR is set
+	 *	when a conversion completes and cleared by reading the power register.
+	 */
+	kWarpINA219BusVoltageOverflowBit	= (1 << 0),
+	kWarpINA219BusVoltageConversionReadyBit	= (1 << 1),
+} WarpINA219ConfigurationBits;
+
+typedef enum
+{
+	kWarpINA219BusRange16V			= 0,
+	kWarpINA219BusRange32V			= 1,
+} WarpINA219BusRange;
+
+typedef enum
+{
+	kWarpINA219Gain1Range40mV		= 0,
+	kWarpINA219Gain2Range80mV		= 1,
+	kWarpINA219Gain4Range160mV		= 2,
+	kWarpINA219Gain8Range320mV		= 3,
+} WarpINA219Gain;
+
+/*
+ *	BADC/SADC settings: a single conversion at 9-12 bits, or the average of
+ *	2-128 12-bit conversions computed on-chip.
+ */
+typedef enum
+{
+	kWarpINA219Adc9Bit			= 0x0,
+	kWarpINA219Adc10Bit			= 0x1,
+	kWarpINA219Adc11Bit			= 0x2,
+	kWarpINA219Adc12Bit			= 0x3,
+	kWarpINA219AdcAverage2			= 0x9,
+	kWarpINA219AdcAverage4			= 0xA,
+	kWarpINA219AdcAverage8			= 0xB,
+	kWarpINA219AdcAverage16			= 0xC,
+	kWarpINA219AdcAverage32			= 0xD,
+	kWarpINA219AdcAverage64			= 0xE,
+	kWarpINA219AdcAverage128		= 0xF,
+} WarpINA219Adc;
+
+typedef enum
+{
+	kWarpINA219ModePowerDown		= 0,
+	kWarpINA219ModeShuntTriggered		= 1,
+	kWarpINA219ModeBusTriggered		= 2,
+	kWarpINA219ModeShuntAndBusTriggered	= 3,
+	kWarpINA219ModeAdcOff			= 4,
+	kWarpINA219ModeShuntContinuous		= 5,
+	kWarpINA219ModeBusContinuous		= 6,
+	kWarpINA219ModeShuntAndBusContinuous	= 7,
+} WarpINA219Mode;
+
+typedef struct
+{
+	WarpINA219BusRange	busRange;
+	WarpINA219Gain		gain;
+	WarpINA219Adc		busAdc;
+	WarpINA219Adc		shuntAdc;
+	WarpINA219Mode		mode;
+	uint16_t		calibration;
+} WarpINA219Profile;
+
+/*
+ *	Shunt, bus, current and power from one INA219 conversion.
+ */
+typedef struct
+{
+	int16_t		shuntVoltage;
+	uint16_t	busVoltage;
+	int16_t		current;
+	uint16_t	power;
+
+	/*
+	 *	Raw bus register status bits: math overflow means current and power
+	 *	are meaningless for this conversion.
+	 */
+	bool		mathOverflow;
+
+	/*
+	 *	I2C transactions issued and time taken to take the snapshot.
+	 */
+	uint8_t		transactionCount;
+	uint32_t	elapsedMicroseconds;
+} WarpINA219Snapshot;
+
+typedef enum
+{
+	/*
+	 *	A0/A1 strapping selects one of 16 addresses from 0x40. Channels
+	 *	default to the first four (A1 = GND, A0 = GND/VS+/SDA/SCL).
+	 */
+	kWarpINA219BaseAddress			= 0x40,
+	kWarpINA219MaxChannels			= 16,
+	kWarpINA219DefaultChannels		= 4,
+} WarpINA219ChannelConstants;
+
+/*
+ *	One INA219 on a shared bus: its own address and I2C buffer, the latest
+ *	conversion read from it and the scheduler's per-channel accounting.
+ */
+typedef struct
+{
+	WarpI2CDeviceState	i2c;
+	uint32_t		conversionMicroseconds;
+
+	/*
+	 *	For scheduler snapshots, elapsedMicroseconds is the time since the
+	 *	channel's previous snapshot (or since initSchedulerINA219(), for the
+	 *	first).
+	 */
+	WarpINA219Snapshot	snapshot;
+	uint64_t		lastSnapshotMicroseconds;
+
+	uint32_t		snapshotCount;
+	uint32_t		notReadyCount;
+	uint32_t		failedCount;
+} WarpINA219Device;
+
+typedef struct
+{
+	WarpINA219Device *	devices;
+	uint8_t			deviceCount;
+	uint8_t			next;
+} WarpINA219Scheduler;
+
+typedef enum
+{
+	/*
+	 *	TPM0 clocks the acquisition engine. LPTMR0 is already taken by the
+	 *	bare-metal OSA as its millisecond timebase.
+	 */
+	kWarpINA219AcquisitionTimerInstance	= 0,
+	kWarpINA219AcquisitionWindowCount	= 2,
+
+	/*
+	 *	The timer ISR's reads are polled, so it no longer waits on the I2C0
+	 *	interrupt, but it stays less urgent (numerically higher) so that a
+	 *	queued transfer a tick lands in keeps running from the I2C0 ISR.
+	 *	Equal to kSSD1331SpiIrqPriority, so a sample and a display frame's
+	 *	SPI interrupt never preempt each other.
+	 */
+	kWarpINA219AcquisitionIrqPriority	= 3,
+
+	/*
+	 *	Bus time per sample: a bus voltage, shunt voltage and power read, each
+	 *	a START, two address bytes, the register pointer, a repeated START,
+	 *	two data bytes and a STOP. The ISR waits on all of it, so it may
+	 *	take at most kWarpINA219AcquisitionBusPercent of the sample period.
+	 */
+	kWarpINA219ConversionReads		= 3,
+	kWarpINA219ConversionReadBits		= 47,
+	kWarpINA219AcquisitionBusPercent	= 50,
+
+	/*
+	 *	The INA219's conversion times are typical; the maximum is 10% longer.
+	 *	Acquisition leaves this margin so that CNVR is always set in time.
+	 */
+	kWarpINA219ConversionMarginPercent	= 12,
+
+	/*
+	 *	Bus voltage register reads to wait for CNVR in blocking reads. Enough
+	 *	to cover the slowest (128-sample, shunt and bus) profile at 300kHz.
+	 */
+	kWarpINA219ConversionMaxPolls		= 1000,
+
+	/*
+	 *	Transient capture ring: 128 bytes of RAM. A capture is the
+	 *	pre-trigger samples, the trigger sample and the post-trigger
+	 *	samples, which together must fit in the ring.
+	 */
+	kWarpINA219TransientSamples		= 64,
+	kWarpINA219TransientDefaultPreTrigger	= 16,
+	kWarpINA219TransientDefaultPostTrigger	= kWarpINA219TransientSamples - 1 - kWarpINA219TransientDefaultPreTrigger,
+} WarpINA219AcquisitionConstants;
+
+typedef enum
+{
+	kWarpINA219TransientDisarmed,
+	kWarpINA219TransientArmed,
+	kWarpINA219TransientCapturing,
+	kWarpINA219TransientFrozen,
+} WarpINA219TransientState;
+
+typedef enum
+{
+	kWarpINA219TransientCauseLevel		= (1 << 0),
+	kWarpINA219TransientCauseSlope		= (1 << 1),
+} WarpINA219TransientCause;
+
+typedef struct
+{
+	/*
+	 *	Every acquired sample goes into the ring until a capture freezes it.
+	 *	Once frozen, the oldest sample is at writeIndex, and the ISR leaves
+	 *	the ring alone until the capture is re-armed.
+	 */
+	int16_t		samples[kWarpINA219TransientSamples];
+	uint8_t		writeIndex;
+	uint8_t		filled;
+	uint8_t		postTriggerRemaining;
+	uint8_t		preTriggerSamples;
+	uint8_t		postTriggerSamples;
+	int16_t		previousSample;
+	WarpINA219TransientState	state;
+
+	/*
+	 *	Trigger on |sample| >= levelThreshold or |sample - previous| >=
+	 *	slopeThreshold, in shunt register LSBs. Zero disables either test.
+	 */
+	uint16_t	levelThreshold;
+	uint16_t	slopeThreshold;
+
+	uint8_t		cause;
+	uint32_t	triggerWindow;
+	uint32_t	captureCount;
+} WarpINA219TransientCapture;
+
+typedef struct
+{
+	/*
+	 *	Ping/pong sample windows. The timer ISR fills samples[fillWindow] while
+	 *	main() owns whichever window has its bit set in readyMask.
+	 */
+	int16_t		samples[kWarpINA219AcquisitionWindowCount][kWarpSizesINA219WindowSamples];
+
+	/*
+	 *	Updated by the ISR as each sample arrives, so a window's statistics
+	 *	are ready as soon as the window is.
+	 */
+	WarpStatisticsAccumulator	statistics[kWarpINA219AcquisitionWindowCount];
+	uint8_t		fillWindow;
+	uint8_t		fillIndex;
+	uint8_t		readyMask;
+	bool		running;
+
+	/*
+	 *	Windows in gapMask did not carry straight on from the window before
+	 *	them: periods were lost (a window dropped, or a partial window
+	 *	discarded) after it. Cycle tracking must start again at such a window.
+	 */
+	uint8_t		gapMask;
+	bool		gapPending;
+
+	uint32_t	samplePeriodMicroseconds;
+	uint32_t	timerTicksPerSample;
+
+	uint32_t	windowsCompleted;
+	uint32_t	windowsDropped;
+	uint32_t	readsFailed;
+
+	/*
+	 *	Timer periods at which the INA219 had no new conversion (CNVR clear).
+	 *	No sample is stored for these, so a stale value is never re-read, and
+	 *	the partial window they interrupt is discarded (windowsFailed,
+	 *	samplesDiscarded) rather than completed with uneven spacing.
+	 */
+	uint32_t	conversionsNotReady;
+	uint32_t	windowsFailed;
+	uint32_t	samplesDiscarded;
+
+	/*
+	 *	Timer periods that went by with no ISR at all, while interrupts were
+	 *	masked (a flash erase, an I2C bus recovery) or the ISR overran: TPM0
+	 *	collapses these into one pending overflow. They are counted against
+	 *	the LPTMR's free-running millisecond count (the OSA timebase, which
+	 *	keeps counting with interrupts masked), read at every ISR entry into
+	 *	lastEntryMilliseconds, and treated like conversionsNotReady.
+	 */
+	uint32_t	periodsMissed;
+	uint16_t	lastEntryMilliseconds;
+
+	/*
+	 *	Time the INA219 takes per result under the current configuration,
+	 *	set by configureSensorINA219(). Acquisition never samples faster.
+	 */
+	uint32_t	conversionMicroseconds;
+
+	/*
+	 *	TPM counts between the overflow that requested a sample and entry into
+	 *	the ISR. This is the sample-spacing jitter.
+	 */
+	uint16_t	maxLatencyTicks;
+
+	WarpINA219TransientCapture	transient;
+} WarpINA219AcquisitionState;
+
 void		initINA219(const uint8_t i2cAddress, WarpI2CDeviceState volatile *  deviceStatePointer);
 WarpStatus	readSensorRegisterINA219(uint8_t deviceRegister, int numberOfBytes);
 WarpStatus	writeSensorRegisterINA219(uint8_t deviceRegister,
-					uint8_t payloadBtye,
+					uint16_t payload,
 					uint16_t menuI2cPullupValue);
-WarpStatus	configureSensorINA219(uint8_t payloadF_SETUP, uint16_t menuI2cPullupValue);
+WarpStatus	configureSensorINA219(uint16_t payloadConfiguration, uint16_t payloadCalibration, uint16_t menuI2cPullupValue);
+WarpStatus	configureProfileINA219(const WarpINA219Profile *  profile, uint16_t menuI2cPullupValue);
+WarpStatus	tuneI2cSpeedINA219(uint16_t menuI2cPullupValue);
+uint32_t	getConversionMicrosecondsINA219(uint16_t configuration);
+WarpStatus	readConversionINA219(int16_t *  shuntVoltage, uint32_t maxPolls);
+WarpStatus	readSnapshotINA219(WarpINA219Snapshot *  snapshot);
+WarpStatus	readSensorRegisterDeviceINA219(WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t deviceRegister, int numberOfBytes);
+WarpStatus	writeSensorRegisterDeviceINA219(WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t deviceRegister, uint16_t payload);
+WarpStatus	configureSensorDeviceINA219(WarpI2CDeviceState volatile *  deviceStatePointer, uint16_t payloadConfiguration, uint16_t payloadCalibration);
+WarpStatus	tuneI2cSpeedDeviceINA219(WarpI2CDeviceState volatile *  deviceStatePointer);
+uint16_t	getProfileConfigurationINA219(const WarpINA219Profile *  profile);
+WarpStatus	readConversionDeviceINA219(WarpI2CDeviceState volatile *  deviceStatePointer, int16_t *  shuntVoltage, uint32_t maxPolls);
+WarpStatus	readSnapshotDeviceINA219(WarpI2CDeviceState volatile *  deviceStatePointer, WarpINA219Snapshot *  snapshot);
+WarpStatus	initDeviceINA219(WarpINA219Device *  device, uint8_t i2cAddress);
+WarpStatus	configureProfileDeviceINA219(WarpINA219Device *  device, const WarpINA219Profile *  profile);
+void		initSchedulerINA219(WarpINA219Scheduler *  scheduler, WarpINA219Device *  devices, uint8_t deviceCount);
+uint8_t		serviceSchedulerINA219(WarpINA219Scheduler *  scheduler);
 WarpStatus	readSensorSignalINA219(WarpTypeMask signal,
 					WarpSignalPrecision precision,
 					WarpSignalAccuracy accuracy,
 					WarpSignalReliability reliability,
 					WarpSignalNoise noise);
 void		printSensorDataINA219(bool hexModeFlag);
+void		repeatedReadSensorDataINA219(int *bufSample, int num_samples);
+WarpStatus	startAcquisitionINA219(uint32_t samplePeriodMicroseconds);
+void		stopAcquisitionINA219(void);
+volatile int16_t *	getReadyWindowINA219(void);
+bool		getReadyStatisticsINA219(WarpStatisticsAccumulator *  statistics);
+bool		getReadyWindowContiguousINA219(void);
+void		releaseWindowINA219(void);
+void		armTransientCaptureINA219(uint16_t levelThreshold, uint16_t slopeThreshold, uint8_t preTriggerSamples, uint8_t postTriggerSamples);
+bool		printTransientCaptureINA219(void);
+void		acquisitionSampleINA219(void);
+void		acquisitionMissedPeriodsINA219(uint32_t periods);
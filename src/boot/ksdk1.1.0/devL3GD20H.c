@@ -56,6 +56,22 @@ extern volatile uint32_t		gWarpI2cBaudRateKbps;
 extern volatile uint32_t		gWarpI2cTimeoutMilliseconds;
 extern volatile uint32_t		gWarpSupplySettlingDelayMilliseconds;
 
+/*
+ *	WHO_AM_I (0x0F) through LOW_ODR (0x39) can be read; the control,
+ *	FIFO and interrupt configuration registers can be written.
+ */
+static const uint32_t	readableRegistersL3GD20H[] = {0xFFFF8000, 0x03FFFFFF};
+static const uint32_t	writableRegistersL3GD20H[] = {0x00000000, 0x03FD403F};
+
+static const WarpRegmap	regmapL3GD20H =
+{
+	.registerCount	= 0x3A,
+	.registerBytes	= 1,
+	.flags		= kWarpRegmapFlagAutoIncrement,
+	.readable	= readableRegistersL3GD20H,
+	.writable	= writableRegistersL3GD20H,
+};
+
 
 
 void
@@ -73,48 +89,7 @@ initL3GD20H(const uint8_t i2cAddress, WarpI2CDeviceState volatile *  deviceState
 WarpStatus
 writeSensorRegisterL3GD20H(uint8_t deviceRegister, uint8_t payload, uint16_t menuI2cPullupValue)
 {
-	uint8_t		payloadByte[1], commandByte[1];
-	i2c_status_t	status;
-
-	switch (deviceRegister)
-	{
-		case 0x20: case 0x21: case 0x22: case 0x23:
-		case 0x24: case 0x25: case 0x2E: case 0x30:
-		case 0x32: case 0x33: case 0x34: case 0x35:
-		case 0x36: case 0x37: case 0x38: case 0x39:
-		{
-			/* OK */
-			break;
-		}
-		
-		default:
-		{
-			return kWarpStatusBadDeviceCommand;
-		}
-	}
-
-	i2c_device_t slave =
-	{
-		.address = deviceL3GD20HState.i2cAddress,
-		.baudRate_kbps = gWarpI2cBaudRateKbps
-	};
-
-	commandByte[0] = deviceRegister;
-	payloadByte[0] = payload;
-	status = I2C_DRV_MasterSendDataBlocking(
-							0 /* I2C instance */,
-							&slave,
-							commandByte,
-							1,
-							payloadByte,
-							1,
-							gWarpI2cTimeoutMilliseconds);
-	if (status != kStatus_I2C_Success)
-	{
-		return kWarpStatusDeviceCommunicationFailed;
-	}
-
-	return kWarpStatusOK;
+	return warpRegmapWrite(&regmapL3GD20H, &deviceL3GD20HState, deviceRegister, payload);
 }
 
 WarpStatus
@@ -140,58 +115,7 @@ configureSensorL3GD20H(uint8_t payloadCTRL1, uint8_t payloadCTRL2, uint8_t paylo
 WarpStatus
 readSensorRegisterL3GD20H(uint8_t deviceRegister, int numberOfBytes)
 {
-	uint8_t		cmdBuf[1] = {0xFF};
-	i2c_status_t	status1, status2;
-
-
-	USED(numberOfBytes);
-	if ((deviceRegister < 0x0F) || (deviceRegister > 0x39))
-	{
-		return kWarpStatusBadDeviceCommand;
-	}
-
-	i2c_device_t slave =
-	{
-		.address = deviceL3GD20HState.i2cAddress,
-		.baudRate_kbps = gWarpI2cBaudRateKbps
-	};
-
-
-	cmdBuf[0] = deviceRegister;
-
-
-	/*
-	 *	Steps (Repeated single-byte read. See STable 15 and Table 16 of L3GD20H manual.):
-	 *
-	 *	(1) Write transaction beginning with start condition, slave address, and sub address.
-	 *
-	 *	(2) Read transaction beginning with start condition, followed by slave address, and read 1 byte payload
-	 */
-
-	status1 = I2C_DRV_MasterSendDataBlocking(
-							0 /* I2C peripheral instance */,
-							&slave,
-							cmdBuf,
-							1,
-							NULL,
-							0,
-							gWarpI2cTimeoutMilliseconds);
-		
-	status2 = I2C_DRV_MasterReceiveDataBlocking(
-							0 /* I2C peripheral instance */,
-							&slave,
-							cmdBuf,
-							1,
-							(uint8_t *)deviceL3GD20HState.i2cBuffer,
-							numberOfBytes,
-							gWarpI2cTimeoutMilliseconds);
-
-	if ((status1 != kStatus_I2C_Success) || (status2 != kStatus_I2C_Success))
-	{
-		return kWarpStatusDeviceCommunicationFailed;
-	}
-
-	return kWarpStatusOK;
+	return warpRegmapRead(&regmapL3GD20H, &deviceL3GD20HState, deviceRegister, numberOfBytes);
 }
 
 
@@ -56,6 +56,21 @@ extern volatile uint32_t		gWarpI2cBaudRateKbps;
 extern volatile uint32_t		gWarpI2cTimeoutMilliseconds;
 extern volatile uint32_t		gWarpSupplySettlingDelayMilliseconds;
 
+/*
+ *	All of 0x00-0x11 can be read; the offset and control registers
+ *	(0x09-0x0E, 0x10, 0x11) can be written.
+ */
+static const uint32_t	writableRegistersMAG3110[] = {0x00037E00};
+
+static const WarpRegmap	regmapMAG3110 =
+{
+	.registerCount	= 0x12,
+	.registerBytes	= 1,
+	.flags		= kWarpRegmapFlagAutoIncrement,
+	.readable	= NULL,
+	.writable	= writableRegistersMAG3110,
+};
+
 
 
 void
@@ -75,46 +90,7 @@ initMAG3110(const uint8_t i2cAddress, WarpI2CDeviceState volatile *  deviceState
 WarpStatus
 writeSensorRegisterMAG3110(uint8_t deviceRegister, uint8_t payload, uint16_t menuI2cPullupValue)
 {
-	uint8_t		payloadByte[1], commandByte[1];
-	i2c_status_t	returnValue;
-
-	switch (deviceRegister)
-	{
-		case 0x09: case 0x0A: case 0x0B: case 0x0C:
-		case 0x0D: case 0x0E: case 0x10: case 0x11:
-		{
-			/* OK */
-			break;
-		}
-		
-		default:
-		{
-			return kWarpStatusBadDeviceCommand;
-		}
-	}
-
-	i2c_device_t slave =
-	{
-		.address = deviceMAG3110State.i2cAddress,
-		.baudRate_kbps = gWarpI2cBaudRateKbps
-	};
-
-	commandByte[0] = deviceRegister;
-	payloadByte[0] = payload;
-	returnValue = I2C_DRV_MasterSendDataBlocking(
-							0 /* I2C instance */,
-							&slave,
-							commandByte,
-							1,
-							payloadByte,
-							1,
-							gWarpI2cTimeoutMilliseconds);
-	if (returnValue != kStatus_I2C_Success)
-	{
-		return kWarpStatusDeviceCommunicationFailed;
-	}
-
-	return kWarpStatusOK;
+	return warpRegmapWrite(&regmapMAG3110, &deviceMAG3110State, deviceRegister, payload);
 }
 
 WarpStatus
@@ -140,52 +116,7 @@ configureSensorMAG3110(uint8_t payloadCTRL_REG1, uint8_t payloadCTRL_REG2, uint1
 WarpStatus
 readSensorRegisterMAG3110(uint8_t deviceRegister, int numberOfBytes)
 {
-	uint8_t		cmdBuf[1]	= {0xFF};
-	i2c_status_t	status1, status2;
-
-
-	USED(numberOfBytes);
-	i2c_device_t slave =
-	{
-		.address = deviceMAG3110State.i2cAddress,
-		.baudRate_kbps = gWarpI2cBaudRateKbps
-	};
-
-
-	/*
-	 *	Steps (Repeated single-byte read. See Section 4.2.2 of MAG3110 manual.):
-	 *
-	 *	(1) Write transaction beginning with start condition, slave address, and pointer address.
-	 *
-	 *	(2) Read transaction beginning with start condition, followed by slave address, and read 1 byte payload
-	*/
-
-	cmdBuf[0] = deviceRegister;
-
-	status1 = I2C_DRV_MasterSendDataBlocking(
-							0 /* I2C peripheral instance */,
-							&slave,
-							cmdBuf,
-							1,
-							NULL,
-							0,
-							gWarpI2cTimeoutMilliseconds);
-
-	status2 = I2C_DRV_MasterReceiveDataBlocking(
-							0 /* I2C peripheral instance */,
-							&slave,
-							cmdBuf,
-							1,
-							(uint8_t *)deviceMAG3110State.i2cBuffer,
-							numberOfBytes,
-							gWarpI2cTimeoutMilliseconds);
-
-	if ((status1 != kStatus_I2C_Success) || (status2 != kStatus_I2C_Success))
-	{
-		return kWarpStatusDeviceCommunicationFailed;
-	}
-
-	return kWarpStatusOK;
+	return warpRegmapRead(&regmapMAG3110, &deviceMAG3110State, deviceRegister, numberOfBytes);
 }
 
 void
@@ -1,6 +1,8 @@
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "fsl_spi_master_driver.h"
+#include "fsl_spi_shared_function.h"
 #include "fsl_port_hal.h"
 
 #include "SEGGER_RTT.h"
@@ -22,135 +24,183 @@ enum
 	kSSD1331PinRST		= GPIO_MAKE_PIN(HW_GPIOB, 0),
 };
 
-static int
-writeCommand(uint8_t commandByte)
+/*
+ *	/CS and DC change on every flush, so they are driven through their
+ *	FGPIO aliases; resolved in devSSD1331init().
+ */
+static WarpFastGpio	chipSelect;
+static WarpFastGpio	dataCommand;
+
+/*
+ *	Running total of bytes clocked out over SPI, and the bytes the last
+ *	drawNumbersPower() call took.
+ */
+static uint32_t		spiBytesSent;
+static uint32_t		frameBytes;
+
+extern volatile uint32_t	gWarpSpiBaudRateKbps;
+
+static SSD1331Governor	governor =
 {
-	spi_status_t status;
+	.frameIntervalMilliseconds	= 1000 / kSSD1331GovernorDefaultFramesPerSecond,
+	.budgetMicroseconds		= kSSD1331GovernorDefaultBudgetMicroseconds,
+};
 
+static SSD1331PowerManager	powerManager =
+{
+	.dimAfterMilliseconds	= kSSD1331PowerDefaultDimAfterSeconds * 1000,
+	.blankAfterMilliseconds	= kSSD1331PowerDefaultBlankAfterSeconds * 1000,
+	.wakeThresholdWatts	= kSSD1331PowerDefaultWakeThresholdWatts,
+	.state			= kSSD1331DisplayNormal,
+};
 
-	volatile uint8_t	inBuffer[1];
-	volatile uint8_t	payloadBytes[1];
+/*
+ *	In non-blocking mode a flush starts an interrupt-driven transfer and
+ *	returns; SPI0_IRQHandler() raises /CS and clears transferInFlight when
+ *	the last byte is out. frameBusyMicroseconds is the time the last
+ *	drawNumbersPower() call spent before returning to its caller.
+ */
+static bool		nonBlockingTransfers = true;
+static volatile bool	transferInFlight;
+static uint32_t		frameBusyMicroseconds;
 
-	/*
-	 *	Drive /CS low.
-	 *
-	 *	Make sure there is a high-to-low transition by first driving high, delay, then drive low.
-	 */
-	GPIO_DRV_SetPinOutput(kSSD1331PinCSn);
-	OSA_TimeDelay(0.1);//reduce to 0.1ms from 10ms for speed
-	GPIO_DRV_ClearPinOutput(kSSD1331PinCSn);
+/*
+ *	Drawing commands are appended here rather than sent one at a time, and
+ *	go out together as one DC-low, /CS-low transfer when flushed (or when
+ *	the buffer fills). Commands and their arguments are all sent with DC
+ *	low, so a frame's worth can be concatenated freely.
+ *
+ *	There are two buffers: a flush sends the one being filled and switches
+ *	to the other, so drawing carries on while the last flush goes out and
+ *	only the next flush has to wait for it.
+ */
+static uint8_t		commandBuffers[2][kSSD1331CommandBufferBytes];
+static uint8_t *	commandBuffer = commandBuffers[0];
+static uint8_t		commandBufferCount;
 
-	/*
-	 *	Drive DC low (command).
-	 */
-	GPIO_DRV_ClearPinOutput(kSSD1331PinDC);
-	
-	payloadBytes[1] = commandByte;
-	
-	status = SPI_DRV_MasterTransferBlocking(0	/* master instance */,
-					NULL		/* spi_master_user_config_t */,
-					(const uint8_t * restrict)&payloadBytes[1],
-					(uint8_t * restrict)&inBuffer[1],
-					1		/* transfer size */,
-					1		/* timeout in microseconds (unlike I2C which is ms) */);
+/*
+ *	Wait for an in-flight transfer to finish, since its bytes are still
+ *	being read out of the other command buffer. Gives up (and aborts the
+ *	transfer) after kSSD1331TransferTimeoutMilliseconds.
+ */
+static int
+waitForTransfer(void)
+{
+	uint64_t	startMicroseconds = OSA_TimeGetUsec();
 
-	/*
-	 *	Drive /CS high
-	 */
-	GPIO_DRV_SetPinOutput(kSSD1331PinCSn);
 
-	return status;
+	while (transferInFlight)
+	{
+		if ((OSA_TimeGetUsec() - startMicroseconds) > kSSD1331TransferTimeoutMilliseconds * 1000)
+		{
+			SPI_DRV_MasterAbortTransfer(0);
+			warpFastGpioSet(&chipSelect);
+			transferInFlight = false;
+
+			return kStatus_SPI_Timeout;
+		}
+	}
+
+	return kStatus_SPI_Success;
 }
 
 static int
-writeColor(uint8_t commandByte[3], int transfer_size)
+flushCommands(void)
 {
 	spi_status_t status;
 
 
-	volatile uint8_t	inBuffer[transfer_size];
-	volatile uint8_t	payloadBytes[transfer_size];
+	if (commandBufferCount == 0)
+	{
+		return kStatus_SPI_Success;
+	}
+
+	waitForTransfer();
 
 	/*
 	 *	Drive /CS low.
 	 *
 	 *	Make sure there is a high-to-low transition by first driving high, delay, then drive low.
 	 */
-	GPIO_DRV_SetPinOutput(kSSD1331PinCSn);
-	OSA_TimeDelay(0.1);//reduce to 0.1ms from 10ms for speed
-	GPIO_DRV_ClearPinOutput(kSSD1331PinCSn);
+	warpFastGpioSet(&chipSelect);
+	OSA_TimeDelayUs(kSSD1331ChipSelectSettleMicroseconds);
+	warpFastGpioClear(&chipSelect);
 
 	/*
 	 *	Drive DC low (command).
 	 */
-	GPIO_DRV_ClearPinOutput(kSSD1331PinDC);
-	
-	for (int i = 0; i < transfer_size; i++)
-	{ 
-		payloadBytes[i] = commandByte[i];
+	warpFastGpioClear(&dataCommand);
 
+	spiBytesSent += commandBufferCount;
 
+	if (nonBlockingTransfers)
+	{
+		/*
+		 *	/CS stays low until SPI0_IRQHandler() sees the transfer finish.
+		 */
+		transferInFlight = true;
+		status = SPI_DRV_MasterTransfer(0	/* master instance */,
+						NULL		/* spi_master_user_config_t */,
+						(const uint8_t * restrict)commandBuffer,
+						NULL		/* receive buffer: nothing to read back */,
+						commandBufferCount	/* transfer size */);
+		commandBuffer = (commandBuffer == commandBuffers[0]) ? commandBuffers[1] : commandBuffers[0];
+		commandBufferCount = 0;
+
+		if (status != kStatus_SPI_Success)
+		{
+			transferInFlight = false;
+			warpFastGpioSet(&chipSelect);
+		}
+
+		return status;
 	}
+
 	status = SPI_DRV_MasterTransferBlocking(0	/* master instance */,
 					NULL		/* spi_master_user_config_t */,
-					(const uint8_t * restrict)&payloadBytes,
-					(uint8_t * restrict)&inBuffer,
-					transfer_size	/* transfer size */,
-					1		/* timeout in microseconds (unlike I2C which is ms) */);
+					(const uint8_t * restrict)commandBuffer,
+					NULL		/* receive buffer: nothing to read back */,
+					commandBufferCount	/* transfer size */,
+					1000		/* timeout in microseconds (unlike I2C which is ms) */);
+	commandBufferCount = 0;
 
 	/*
 	 *	Drive /CS high
 	 */
-	GPIO_DRV_SetPinOutput(kSSD1331PinCSn);
+	warpFastGpioSet(&chipSelect);
 
 	return status;
 }
 
 static int
-writeLine(uint8_t commandByte[8])
+appendCommands(const uint8_t *  commandBytes, uint8_t count)
 {
-	spi_status_t status;
+	int	status = kStatus_SPI_Success;
 
-	int 				transfer_size = 8;
-	volatile uint8_t	inBuffer[transfer_size];
-	volatile uint8_t	payloadBytes[transfer_size];
-	
 
 	/*
-	 *	Drive /CS low.
-	 *
-	 *	Make sure there is a high-to-low transition by first driving high, delay, then drive low.
+	 *	The buffer being filled is never the one in flight, so there is
+	 *	only a wait (in flushCommands()) if it fills before the last
+	 *	transfer has finished.
 	 */
-	GPIO_DRV_SetPinOutput(kSSD1331PinCSn);
-	OSA_TimeDelay(0.1);//reduce to 0.1ms from 10ms for speed
-	GPIO_DRV_ClearPinOutput(kSSD1331PinCSn);
-
-	/*
-	 *	Drive DC low (command).
-	 */
-	GPIO_DRV_ClearPinOutput(kSSD1331PinDC);
-	
-	for (int i = 0; i < transfer_size; i++)
-	{ 
-		payloadBytes[i] = commandByte[i];
-
-
+	if (commandBufferCount + count > kSSD1331CommandBufferBytes)
+	{
+		status = flushCommands();
 	}
-	status = SPI_DRV_MasterTransferBlocking(0	/* master instance */,
-					NULL		/* spi_master_user_config_t */,
-					(const uint8_t * restrict)&payloadBytes,
-					(uint8_t * restrict)&inBuffer,
-					transfer_size	/* transfer size */,
-					1		/* timeout in microseconds (unlike I2C which is ms) */);
 
-	/*
-	 *	Drive /CS high
-	 */
-	GPIO_DRV_SetPinOutput(kSSD1331PinCSn);
+	for (uint8_t i = 0; i < count; i++)
+	{
+		commandBuffer[commandBufferCount++] = commandBytes[i];
+	}
 
 	return status;
 }
 
+static int
+writeCommand(uint8_t commandByte)
+{
+	return appendCommands(&commandByte, 1);
+}
 
 // Set initial number colour to be cyan
 uint8_t numberColorR = 0x00;
@@ -166,100 +216,101 @@ uint8_t backgrColorB = 0x00;
 
 uint8_t backgrColor[3] = {0x00, 0x00, 0x00};
 
-
-static int
-writeWatts()
+/*
+ *	Glyph strokes: each point is kSSD1331GlyphX<x> | y, scaled and offset
+ *	when drawn. A glyph's first rectangleCount strokes are rectangles given
+ *	by opposite corners, the rest are lines.
+ */
+static const uint8_t	glyphStrokes[] =
 {
-	// Write the W denoting the measurement of Watts
-	spi_status_t status;
-
-	int 				transfer_size = 32;
-	volatile uint8_t	inBuffer[transfer_size];
-	
-	
-
-	/*
-	 *	Drive /CS low.
-	 *
-	 *	Make sure there is a high-to-low transition by first driving high, delay, then drive low.
-	 */
-	GPIO_DRV_SetPinOutput(kSSD1331PinCSn);
-	OSA_TimeDelay(0.1); //reduce to 0.1ms from 10ms for speed
-	GPIO_DRV_ClearPinOutput(kSSD1331PinCSn);
-
-	/*
-	 *	Drive DC low (command).
-	 */
-	GPIO_DRV_ClearPinOutput(kSSD1331PinDC);
-
-	volatile uint8_t payloadBytes[32] = {0x21, 0x51, 0x07, 0x51, 0x38, numberColorR, numberColorG, numberColorB,  /* Draw left hand line */
-					     0x21, 0x51, 0x38, 0x56, 0x2E, numberColorR, numberColorG, numberColorB,  /* Draw left upward diagonal */
-					     0x21, 0x5C, 0x38, 0x57, 0x2E, numberColorR, numberColorG, numberColorB,  /* Draw right downward diagonal */
-					     0x21, 0x5C, 0x07, 0x5C, 0x38, numberColorR, numberColorG, numberColorB}; /* Draw right hand line */
-
-
-	status = SPI_DRV_MasterTransferBlocking(0	/* master instance */,
-					NULL		/* spi_master_user_config_t */,
-					(const uint8_t * restrict)&payloadBytes,
-					(uint8_t * restrict)&inBuffer,
-					32	/* transfer size */,
-					1000	/* timeout in microseconds (unlike I2C which is ms) */);
-
-	/*
-	 *	Drive /CS high
-	 */
-	GPIO_DRV_SetPinOutput(kSSD1331PinCSn);
-
-	return status;
-}
+	/*	0	*/	kSSD1331GlyphX0 | 0, kSSD1331GlyphX7 | 16,
+	/*	1	*/	kSSD1331GlyphX7 | 0, kSSD1331GlyphX7 | 16,
+	/*	2	*/	kSSD1331GlyphX0 | 0, kSSD1331GlyphX7 | 0,	kSSD1331GlyphX7 | 0, kSSD1331GlyphX7 | 8,
+				kSSD1331GlyphX0 | 8, kSSD1331GlyphX7 | 8,	kSSD1331GlyphX0 | 8, kSSD1331GlyphX0 | 16,
+				kSSD1331GlyphX0 | 16, kSSD1331GlyphX7 | 16,
+	/*	3	*/	kSSD1331GlyphX0 | 0, kSSD1331GlyphX7 | 0,	kSSD1331GlyphX7 | 0, kSSD1331GlyphX7 | 16,
+				kSSD1331GlyphX0 | 8, kSSD1331GlyphX7 | 8,	kSSD1331GlyphX0 | 16, kSSD1331GlyphX7 | 16,
+	/*	4	*/	kSSD1331GlyphX0 | 0, kSSD1331GlyphX0 | 8,	kSSD1331GlyphX7 | 0, kSSD1331GlyphX7 | 16,
+				kSSD1331GlyphX0 | 8, kSSD1331GlyphX7 | 8,
+	/*	5	*/	kSSD1331GlyphX0 | 0, kSSD1331GlyphX7 | 0,	kSSD1331GlyphX0 | 0, kSSD1331GlyphX0 | 8,
+				kSSD1331GlyphX0 | 8, kSSD1331GlyphX7 | 8,	kSSD1331GlyphX7 | 8, kSSD1331GlyphX7 | 16,
+				kSSD1331GlyphX0 | 16, kSSD1331GlyphX7 | 16,
+	/*	6	*/	kSSD1331GlyphX0 | 0, kSSD1331GlyphX7 | 0,	kSSD1331GlyphX0 | 0, kSSD1331GlyphX0 | 16,
+				kSSD1331GlyphX0 | 8, kSSD1331GlyphX7 | 8,	kSSD1331GlyphX7 | 8, kSSD1331GlyphX7 | 16,
+				kSSD1331GlyphX0 | 16, kSSD1331GlyphX7 | 16,
+	/*	7	*/	kSSD1331GlyphX0 | 0, kSSD1331GlyphX7 | 0,	kSSD1331GlyphX7 | 0, kSSD1331GlyphX7 | 16,
+	/*	8	*/	kSSD1331GlyphX0 | 0, kSSD1331GlyphX7 | 16,	kSSD1331GlyphX0 | 8, kSSD1331GlyphX7 | 8,
+	/*	9	*/	kSSD1331GlyphX0 | 0, kSSD1331GlyphX7 | 0,	kSSD1331GlyphX0 | 0, kSSD1331GlyphX0 | 8,
+				kSSD1331GlyphX7 | 0, kSSD1331GlyphX7 | 16,	kSSD1331GlyphX0 | 8, kSSD1331GlyphX7 | 8,
+				kSSD1331GlyphX0 | 16, kSSD1331GlyphX7 | 16,
+	/*	-	*/	kSSD1331GlyphX0 | 8, kSSD1331GlyphX7 | 8,
+	/*	.	*/	kSSD1331GlyphX0 | 15, kSSD1331GlyphX1 | 16,
+	/*	k	*/	kSSD1331GlyphX0 | 0, kSSD1331GlyphX0 | 16,	kSSD1331GlyphX1 | 8, kSSD1331GlyphX4 | 0,
+				kSSD1331GlyphX1 | 9, kSSD1331GlyphX4 | 16,
+	/*	W	*/	kSSD1331GlyphX0 | 0, kSSD1331GlyphX0 | 16,	kSSD1331GlyphX0 | 16, kSSD1331GlyphX2 | 13,
+				kSSD1331GlyphX4 | 16, kSSD1331GlyphX2 | 13,	kSSD1331GlyphX4 | 0, kSSD1331GlyphX4 | 16,
+	/*	A	*/	kSSD1331GlyphX0 | 16, kSSD1331GlyphX3 | 0,	kSSD1331GlyphX3 | 0, kSSD1331GlyphX7 | 16,
+				kSSD1331GlyphX1 | 10, kSSD1331GlyphX6 | 10,
+	/*	V	*/	kSSD1331GlyphX0 | 0, kSSD1331GlyphX3 | 16,	kSSD1331GlyphX3 | 16, kSSD1331GlyphX7 | 0,
+};
 
-static int
-writeKilo()
+static const SSD1331Glyph	glyphs[] =
 {
-	// Write a K to denote measuring kilo watts
-	spi_status_t status;
-
-	int 				transfer_size = 24;
-	volatile uint8_t	inBuffer[transfer_size];	
-
-	/*
-	 *	Drive /CS low.
-	 *
-	 *	Make sure there is a high-to-low transition by first driving high, delay, then drive low.
-	 */
-	GPIO_DRV_SetPinOutput(kSSD1331PinCSn);
-	OSA_TimeDelay(0.1);//reduce to 0.1ms from 10ms for speed
-	GPIO_DRV_ClearPinOutput(kSSD1331PinCSn);
-
-	/*
-	 *	Drive DC low (command).
-	 */
-	GPIO_DRV_ClearPinOutput(kSSD1331PinDC);
-
-	volatile uint8_t payloadBytes[24] = {0x21, 0x54, 0x12, 0x54, 0x29, numberColorR, numberColorG, numberColorB,   /* Draw left hand line    */
-					     0x21, 0x55, 0x1C, 0x59, 0x12, numberColorR, numberColorG, numberColorB,   /* Draw upward diagonal   */
-					     0x21, 0x55, 0x1D, 0x59, 0x29, numberColorR, numberColorG, numberColorB};  /* Draw downward diagonal */
+	/*	character, width, firstStroke, rectangleCount, strokeCount, flags	*/
+	{'0', 7, 0,	1, 1, 0},
+	{'1', 7, 1,	0, 1, 0},
+	{'2', 7, 2,	0, 5, 0},
+	{'3', 7, 7,	0, 4, 0},
+	{'4', 7, 11,	0, 3, 0},
+	{'5', 7, 14,	0, 5, 0},
+	{'6', 7, 19,	0, 5, 0},
+	{'7', 7, 24,	0, 2, 0},
+	{'8', 7, 26,	1, 2, 0},
+	{'9', 7, 28,	0, 5, 0},
+	{'-', 7, 33,	0, 1, 0},
+	{'.', 1, 34,	1, 1, kSSD1331GlyphFilled},
+	{'k', 4, 35,	0, 3, 0},
+	{'W', 4, 38,	0, 4, 0},
+	{'A', 7, 42,	0, 3, 0},
+	{'V', 7, 45,	0, 2, 0},
+};
 
+/*
+ *	Retained state of each cell, and the rectangle (x0, y0, x1, y1) that
+ *	holds everything drawn in it. The k is drawn inside the W, so they share
+ *	one cell.
+ */
+static SSD1331Cell	cells[kSSD1331CellCount];
 
-	status = SPI_DRV_MasterTransferBlocking(0	/* master instance */,
-					NULL		/* spi_master_user_config_t */,
-					(const uint8_t * restrict)&payloadBytes,
-					(uint8_t * restrict)&inBuffer,
-					24	/* transfer size */,
-					1000		/* timeout in microseconds (unlike I2C which is ms) */);
+/*
+ *	Downsampled power history, oldest first from historyStart, in tens of
+ *	watts (clamped to 255). historyDrawn is cleared when the panel is
+ *	cleared, so the next column redraws the whole strip.
+ */
+static uint8_t		history[kSSD1331HistoryColumns];
+static uint8_t		historyStart;
+static uint32_t		historySum;
+static uint8_t		historyCount;
+static bool		historyDrawn;
 
-	/*
-	 *	Drive /CS high
-	 */
-	GPIO_DRV_SetPinOutput(kSSD1331PinCSn);
+static const uint8_t	cellBounds[kSSD1331CellCount][4] =
+{
+	[kSSD1331CellDigitRight]	= {0x37, 0x07, 0x37 + 7*kSSD1331GlyphScaleDigit, 0x07 + 16*kSSD1331GlyphScaleDigit},
+	[kSSD1331CellDigitMiddle]	= {0x1D, 0x07, 0x1D + 7*kSSD1331GlyphScaleDigit, 0x07 + 16*kSSD1331GlyphScaleDigit},
+	[kSSD1331CellDigitLeft]		= {0x03, 0x07, 0x03 + 7*kSSD1331GlyphScaleDigit, 0x07 + 16*kSSD1331GlyphScaleDigit},
+	[kSSD1331CellPointMiddle]	= {0x33, 0x07 + 15*kSSD1331GlyphScaleDigit, 0x33 + 1*kSSD1331GlyphScaleDigit, 0x07 + 16*kSSD1331GlyphScaleDigit},
+	[kSSD1331CellPointLeft]		= {0x19, 0x07 + 15*kSSD1331GlyphScaleDigit, 0x19 + 1*kSSD1331GlyphScaleDigit, 0x07 + 16*kSSD1331GlyphScaleDigit},
+	[kSSD1331CellUnit]		= {0x51, 0x07, 0x51 + 4*kSSD1331GlyphScaleDigit, 0x07 + 16*kSSD1331GlyphScaleDigit},
+};
 
-	return status;
-}
 
 
 int
 devSSD1331init(void)
 {
+	warpFastGpioInit(&chipSelect, kSSD1331PinCSn);
+	warpFastGpioInit(&dataCommand, kSSD1331PinDC);
+
 	/*
 	 *	Override Warp firmware's use of these pins.
 	 *
@@ -270,6 +321,12 @@ devSSD1331init(void)
 
 	enableSPIpins();
 
+	/*
+	 *	Frames are sent from the SPI interrupt; keep it from preempting
+	 *	the I2C interrupt that runs the transaction queue.
+	 */
+	NVIC_SetPriority(SPI0_IRQn, kSSD1331SpiIrqPriority);
+
 	/*
 	 *	Override Warp firmware's use of these pins.
 	 *
@@ -329,6 +386,12 @@ devSSD1331init(void)
 	writeCommand(0xFF);
 	writeCommand(kSSD1331CommandCONTRASTC);		// 0x83
 	writeCommand(0x7D);
+	writeCommand(kSSD1331CommandDIMMODESETTING);	// 0xAB
+	writeCommand(0x00);				// Reserved
+	writeCommand(kSSD1331DimContrastA);
+	writeCommand(kSSD1331DimContrastB);
+	writeCommand(kSSD1331DimContrastC);
+	writeCommand(kSSD1331DimPrecharge);
 	writeCommand(kSSD1331CommandDISPLAYON);		// Turn on oled panel
 
 	/*
@@ -337,270 +400,579 @@ devSSD1331init(void)
 	writeCommand(kSSD1331CommandFILL);
 	writeCommand(0x01);
 
-	/*
-	 *	Clear Screen
-	 */
-	writeCommand(kSSD1331CommandCLEAR);
-	writeCommand(0x00);
-	writeCommand(0x00);
-	writeCommand(0x5F);
-	writeCommand(0x3F);	
+	devSSD1331ClearScreen();
 
 	return 0;
 }
 
+static void
+clearWindow(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
+{
+	writeCommand(kSSD1331CommandCLEAR);
+	writeCommand(x0);
+	writeCommand(y0);
+	writeCommand(x1);
+	writeCommand(y1);
+}
+
+/*
+ *	Clear the whole panel and forget what the cells held, so the next
+ *	drawNumbersPower() draws everything.
+ */
+void
+devSSD1331ClearScreen(void)
+{
+	clearWindow(0x00, 0x00, 0x5F, 0x3F);
+	flushCommands();
 
+	for (uint8_t i = 0; i < kSSD1331CellCount; i++)
+	{
+		cells[i].content = kSSD1331CellBlank;
+	}
 
+	historyDrawn = false;
+}
 
-void drawRect(uint8_t positionOffset)
+uint32_t
+devSSD1331GetFrameBytes(void)
 {
-	// Using the line drawing tool to write the first part of the rectangle
-	uint8_t line_buffer[8] = {0x22, 0x03+positionOffset, 0x07, 0x18+positionOffset, 0x38, numberColorR, numberColorG, numberColorB};
-		
-	writeLine(line_buffer);
-	
-	writeColor(backgrColor, 3); // set fill of number same as background	
+	return frameBytes;
 }
-	
-void 
-drawSide(uint8_t positionOffset)
+
+uint32_t
+devSSD1331GetFrameBusyMicroseconds(void)
 {
-	uint8_t line_buffer[8] = {0x21, 0x03+positionOffset, 0x07, 0x03+positionOffset, 0x38, numberColorR, numberColorG, numberColorB};
-		
-	writeLine(line_buffer);
+	return frameBusyMicroseconds;
 }
 
 void
-drawBar(uint8_t positionOffset)
+devSSD1331SetNonBlocking(bool nonBlocking)
 {
-	uint8_t line_buffer[8] = {0x21, 0x03+positionOffset, 0x1F, 0x18+positionOffset, 0x1F, numberColorR, numberColorG, numberColorB};
-		
-	writeLine(line_buffer);
+	waitForTransfer();
+	nonBlockingTransfers = nonBlocking;
 }
 
-void
-drawShortSideLower(uint8_t positionOffset)
+/*
+ *	Other users of SPI0 must call this first: the driver rejects a new
+ *	transfer while a frame is still going out.
+ */
+int
+devSSD1331WaitForTransfer(void)
 {
-	uint8_t line_buffer[8] = {0x21, 0x03+positionOffset, 0x1F, 0x03+positionOffset, 0x38, numberColorR, numberColorG, numberColorB};
-		
-	writeLine(line_buffer);
+	return waitForTransfer();
 }
 
+/*
+ *	Override the SPI0 IRQ handler (fsl_spi_irq.c is not linked in) so the end
+ *	of a non-blocking frame can release /CS from interrupt context.
+ */
 void
-drawShortSideUpper(uint8_t positionOffset)
+SPI0_IRQHandler(void)
 {
-	uint8_t line_buffer[8] = {0x21, 0x03+positionOffset, 0x07, 0x03+positionOffset, 0x1F, numberColorR, numberColorG, numberColorB};
-		
-	writeLine(line_buffer);
+	SPI_DRV_IRQHandler(HW_SPI0);
+
+	if (transferInFlight && (SPI_DRV_MasterGetTransferStatus(0, NULL) != kStatus_SPI_Busy))
+	{
+		warpFastGpioSet(&chipSelect);
+		transferInFlight = false;
+	}
 }
 
-void
-drawBottom(uint8_t positionOffset)
+
+
+
+/*
+ *	Append the line and rectangle commands for one glyph, with its top-left
+ *	corner at (x, y) and each grid unit scale pixels. Returns the glyph's
+ *	advance in pixels (its width plus a one-unit gap), or 0 if there is no
+ *	glyph for the character.
+ */
+uint8_t
+devSSD1331DrawGlyph(char character, uint8_t x, uint8_t y, uint8_t scale)
 {
-	uint8_t line_buffer[8] = {0x21, 0x03+positionOffset, 0x38, 0x18+positionOffset, 0x38, numberColorR, numberColorG, numberColorB};
-		
-	writeLine(line_buffer);
+	const SSD1331Glyph *	glyph = NULL;
+
+
+	for (uint8_t i = 0; i < sizeof(glyphs) / sizeof(glyphs[0]); i++)
+	{
+		if (glyphs[i].character == character)
+		{
+			glyph = &glyphs[i];
+			break;
+		}
+	}
+
+	if (glyph == NULL)
+	{
+		return 0;
+	}
+
+	for (uint8_t i = 0; i < glyph->strokeCount; i++)
+	{
+		const uint8_t *	stroke = &glyphStrokes[(glyph->firstStroke + i) * 2];
+		uint8_t		command[11] =
+		{
+			kSSD1331CommandDRAWLINE,
+			x + (stroke[0] >> 5) * scale,
+			y + (stroke[0] & kSSD1331GlyphYMask) * scale,
+			x + (stroke[1] >> 5) * scale,
+			y + (stroke[1] & kSSD1331GlyphYMask) * scale,
+			numberColorR,
+			numberColorG,
+			numberColorB,
+		};
+
+		if (i < glyph->rectangleCount)
+		{
+			/*
+			 *	Rectangles carry a fill colour too (fill is enabled at init):
+			 *	either the glyph colour or the background for an outline.
+			 */
+			bool	filled = (glyph->flags & kSSD1331GlyphFilled) != 0;
+
+			command[0]	= kSSD1331CommandDRAWRECT;
+			command[8]	= filled ? numberColorR : backgrColorR;
+			command[9]	= filled ? numberColorG : backgrColorG;
+			command[10]	= filled ? numberColorB : backgrColorB;
+			appendCommands(command, 11);
+		}
+		else
+		{
+			appendCommands(command, 8);
+		}
+	}
+
+	return (glyph->width + 1) * scale;
 }
 
+/*
+ *	Draw a string left to right from (x, y), skipping characters without a
+ *	glyph. Returns the x coordinate after the last glyph.
+ */
+uint8_t
+devSSD1331DrawText(const char *  text, uint8_t x, uint8_t y, uint8_t scale)
+{
+	while (*text != '\0')
+	{
+		x += devSSD1331DrawGlyph(*text++, x, y, scale);
+	}
+
+	return x;
+}
+
+/*
+ *	Power as up to kSSD1331DigitCells characters, right-aligned: a sign if
+ *	negative, then the digits without leading zeros. Watts are shown while
+ *	they fit (-99 to 999), then kilowatts with as many decimals as fit
+ *	(1.23, 12.3, 123, -1.2, -12). Anything larger keeps the last frame.
+ */
 void
-drawTop(uint8_t positionOffset)
+drawNumbersPower(int power)
 {
-	uint8_t line_buffer[8] = {0x21, 0x03+positionOffset, 0x07, 0x18+positionOffset, 0x07, numberColorR, numberColorG, numberColorB};
-		
-	writeLine(line_buffer);
+	bool		negative = (power < 0);
+	uint32_t	magnitude = negative ? -(uint32_t)power : (uint32_t)power;
+	uint8_t		digitCells = kSSD1331DigitCells - negative;
+	uint32_t	limit = 1;
+	uint32_t	value = magnitude;
+	uint8_t		decimals = 0;
+	uint8_t		digits = 1;
+	bool		isKiloWatts;
+
+
+	for (uint8_t i = 0; i < digitCells; i++)
+	{
+		limit *= 10;
+	}
+
+	isKiloWatts = (magnitude >= limit);
+	if (isKiloWatts)
+	{
+		uint32_t	divisor = 1000;
+
+		/*
+		 *	Start from the most decimals the cells can hold and give them
+		 *	up until the value fits.
+		 */
+		decimals = digitCells - 1;
+		for (uint8_t i = 0; i < decimals; i++)
+		{
+			divisor /= 10;
+		}
+
+		value = magnitude / divisor;
+		while ((value >= limit) && (decimals > 0))
+		{
+			decimals--;
+			divisor *= 10;
+			value = magnitude / divisor;
+		}
+
+		// Shown in kilowatts, so use red colour
+		numberColorR = 0x39;
+		numberColorG = 0x00;
+		numberColorB = 0x00;
+	}
+	else
+	{
+		// Shown in watts, so use cyan colour
+		numberColorR = 0x00;
+		numberColorG = 0x35;
+		numberColorB = 0x36;
+	}
+
+	// Too large to show, so just keep last value and don't print new numbers
+	if (value >= limit)
+	{
+		/*
+		 *	Nothing is sent, so this frame must not be charged the last one's bytes.
+		 */
+		frameBytes		= 0;
+		frameBusyMicroseconds	= 0;
+
+		return;
+	}
+
+	/*
+	 *	At least one digit before the decimal point (0.5, not .5).
+	 */
+	for (uint32_t rest = value / 10; rest > 0; rest /= 10)
+	{
+		digits++;
+	}
+	digits = max(digits, decimals + 1);
+
+	uint8_t		contents[kSSD1331CellCount];
+	uint32_t	frameStartBytes = spiBytesSent;
+	uint64_t	frameStartMicroseconds = OSA_TimeGetUsec();
+
+	/*
+	 *	The digit cells are numbered from the right, so cell i holds the
+	 *	i-th digit from the right, then the sign, then nothing.
+	 */
+	for (uint8_t i = 0; i < kSSD1331DigitCells; i++)
+	{
+		if (i < digits)
+		{
+			contents[kSSD1331CellDigitRight + i] = '0' + value % 10;
+			value /= 10;
+		}
+		else if (negative && (i == digits))
+		{
+			contents[kSSD1331CellDigitRight + i] = '-';
+		}
+		else
+		{
+			contents[kSSD1331CellDigitRight + i] = kSSD1331CellBlank;
+		}
+	}
+	contents[kSSD1331CellPointMiddle]	= (decimals == 1) ? kSSD1331CellShown : kSSD1331CellBlank;
+	contents[kSSD1331CellPointLeft]		= (decimals == 2) ? kSSD1331CellShown : kSSD1331CellBlank;
+	contents[kSSD1331CellUnit]		= isKiloWatts ? kSSD1331CellKiloWatts : kSSD1331CellWatts;
+
+	/*
+	 *	Only cells whose content or colour changed are touched: the old
+	 *	glyph is cleared with a CLEAR window over just that cell, then the
+	 *	new one is drawn. An unchanged frame sends nothing.
+	 */
+	for (uint8_t i = 0; i < kSSD1331CellCount; i++)
+	{
+		if ((cells[i].content == contents[i]) &&
+			(cells[i].color[0] == numberColorR) &&
+			(cells[i].color[1] == numberColorG) &&
+			(cells[i].color[2] == numberColorB))
+		{
+			continue;
+		}
+
+		if (cells[i].content != kSSD1331CellBlank)
+		{
+			clearWindow(cellBounds[i][0], cellBounds[i][1], cellBounds[i][2], cellBounds[i][3]);
+		}
+
+		switch (i)
+		{
+			case kSSD1331CellDigitRight:
+			case kSSD1331CellDigitMiddle:
+			case kSSD1331CellDigitLeft:
+			{
+				if (contents[i] != kSSD1331CellBlank)
+				{
+					devSSD1331DrawGlyph(contents[i], cellBounds[i][0], cellBounds[i][1], kSSD1331GlyphScaleDigit);
+				}
+				break;
+			}
+
+			case kSSD1331CellPointMiddle:
+			case kSSD1331CellPointLeft:
+			{
+				if (contents[i] == kSSD1331CellShown)
+				{
+					devSSD1331DrawGlyph('.', cellBounds[i][0], 0x07, kSSD1331GlyphScaleDigit);
+				}
+				break;
+			}
+
+			case kSSD1331CellUnit:
+			{
+				// Draw Watts, W letter, and k for kilo inside it
+				devSSD1331DrawGlyph('W', 0x51, 0x07, kSSD1331GlyphScaleDigit);
+				if (contents[i] == kSSD1331CellKiloWatts)
+				{
+					devSSD1331DrawGlyph('k', 0x54, 0x12, 1);
+				}
+				break;
+			}
+		}
+
+		cells[i].content	= contents[i];
+		cells[i].color[0]	= numberColorR;
+		cells[i].color[1]	= numberColorG;
+		cells[i].color[2]	= numberColorB;
+	}
+
+	flushCommands();
+	frameBytes = spiBytesSent - frameStartBytes;
+	frameBusyMicroseconds = OSA_TimeGetUsec() - frameStartMicroseconds;
 }
 
+static void
+drawHistoryColumn(uint8_t x, uint8_t tensOfWatts)
+{
+	uint8_t		rows = kSSD1331HistoryBottom - kSSD1331HistoryTop + 1;
+	uint8_t		height = min((uint32_t)tensOfWatts * 10 * rows / kSSD1331HistoryFullScaleWatts, rows);
+	uint8_t		command[8] =
+	{
+		kSSD1331CommandDRAWLINE,
+		x, kSSD1331HistoryBottom,
+		x, kSSD1331HistoryBottom + 1 - height,
+		numberColorR, numberColorG, numberColorB,
+	};
 
-// Function draws each number at the required position offset (in the x direction)
+	if (height > 0)
+	{
+		appendCommands(command, 8);
+	}
+}
+
+/*
+ *	Average power over kSSD1331HistoryWindowsPerColumn calls into one new
+ *	history column. The strip is scrolled left one pixel by the panel's
+ *	COPY command and only the newest column is drawn, so an update is 20
+ *	bytes or less rather than a line per column.
+ */
 void
-drawNumber(int number, uint8_t positionOffset)
+devSSD1331PushHistory(int power)
 {
+	historySum += (power > 0) ? power : 0;
+	if (++historyCount < kSSD1331HistoryWindowsPerColumn)
+	{
+		return;
+	}
+
+	history[historyStart] = min(historySum / kSSD1331HistoryWindowsPerColumn / 10, 255);
+	historyStart = (historyStart + 1) % kSSD1331HistoryColumns;
+	historySum = 0;
+	historyCount = 0;
 
-	switch(number)
+	if (historyDrawn)
 	{
-		case 0:
-		
-			// Draw 0
-			drawRect(positionOffset);
-			break;
-			
-		
-		case 1:
-		
-			// Draw 1
-			drawSide(positionOffset+0x15);
-			break;
-		
-		case 2:
-		
-			// Draw 2
-			drawBar(positionOffset);
-			drawTop(positionOffset);
-			drawBottom(positionOffset);
-			drawShortSideLower(positionOffset);
-			drawShortSideUpper(positionOffset+0x15);
-			break;
-		
-		case 3:
-		
-			// Draw 3
-			drawBar(positionOffset);
-			drawTop(positionOffset);
-			drawBottom(positionOffset);
-			drawSide(positionOffset+0x15);
-			break;
-		
-		case 4:
-		
-			// Draw 4
-			drawSide(positionOffset+0x15);
-			drawBar(positionOffset);
-			drawShortSideUpper(positionOffset);
-			break;
-		
-		case 5:
-		
-			// Draw 5
-			drawBar(positionOffset);
-			drawTop(positionOffset);
-			drawBottom(positionOffset);
-			drawShortSideLower(positionOffset+0x15);
-			drawShortSideUpper(positionOffset);
-			break;
-		
-		case 6:
-		
-			// Draw 6
-			drawSide(positionOffset);
-			drawBar(positionOffset);
-			drawTop(positionOffset);
-			drawBottom(positionOffset);
-			drawShortSideLower(positionOffset+0x15);
-			break;
-		
-		case 7:
-		
-			// Draw 7
-			drawSide(positionOffset+0x15);
-			drawTop(positionOffset);
-			break;
-		
-		case 8:
-		
-			// Draw 8
-			drawRect(positionOffset);
-			drawBar(positionOffset);
+		uint8_t		copy[7] =
+		{
+			kSSD1331CommandCOPY,
+			1, kSSD1331HistoryTop, kSSD1331HistoryColumns - 1, kSSD1331HistoryBottom,
+			0, kSSD1331HistoryTop,
+		};
+
+		appendCommands(copy, 7);
+		clearWindow(kSSD1331HistoryColumns - 1, kSSD1331HistoryTop, kSSD1331HistoryColumns - 1, kSSD1331HistoryBottom);
+		drawHistoryColumn(kSSD1331HistoryColumns - 1, history[(historyStart + kSSD1331HistoryColumns - 1) % kSSD1331HistoryColumns]);
+	}
+	else
+	{
+		clearWindow(0, kSSD1331HistoryTop, kSSD1331HistoryColumns - 1, kSSD1331HistoryBottom);
+		for (uint8_t x = 0; x < kSSD1331HistoryColumns; x++)
+		{
+			drawHistoryColumn(x, history[(historyStart + x) % kSSD1331HistoryColumns]);
+		}
+		historyDrawn = true;
+	}
+
+	flushCommands();
+}
+
+/*
+ *	OSA_TimeGetMsec() is the 16-bit LPTMR count and wraps every 65s, too
+ *	soon for idle periods of minutes. This wraps after 49 days.
+ */
+static uint32_t
+getMilliseconds(void)
+{
+	return (uint32_t)(OSA_TimeGetUsec() / 1000);
+}
+
+static void
+setPowerState(SSD1331DisplayPowerState state)
+{
+	if (state == powerManager.state)
+	{
+		return;
+	}
+
+	if (powerManager.state == kSSD1331DisplayBlank)
+	{
+		writeCommand(kSSD1331CommandPOWERMODE);
+		writeCommand(kSSD1331PowerModeNormal);
+	}
+
+	switch (state)
+	{
+		case kSSD1331DisplayNormal:
+		{
+			writeCommand(kSSD1331CommandDISPLAYON);
+			powerManager.wakeCount++;
 			break;
-		
-		case 9:
-		
-			// Draw 9
-			drawBar(positionOffset);
-			drawTop(positionOffset);
-			drawBottom(positionOffset);
-			drawSide(positionOffset+0x15);
-			drawShortSideUpper(positionOffset);
+		}
+
+		case kSSD1331DisplayDim:
+		{
+			writeCommand(kSSD1331CommandDISPLAYDIM);
+			powerManager.dimCount++;
 			break;
-		
-		default:
-		
-			// Should never get here
+		}
+
+		case kSSD1331DisplayBlank:
+		{
+			writeCommand(kSSD1331CommandDISPLAYOFF);
+			writeCommand(kSSD1331CommandPOWERMODE);
+			writeCommand(kSSD1331PowerModeSave);
+			powerManager.blankCount++;
 			break;
-		
+		}
 	}
-	
+
+	flushCommands();
+	powerManager.state = state;
 }
 
-void
-drawNumbersPower(int power)
+static SSD1331DisplayPowerState
+updatePowerState(int power, uint32_t nowMilliseconds)
 {
+	uint32_t	idleMilliseconds;
+	int		change = power - powerManager.referencePower;
 
-	
-	int power_val1;
-	int power_val2;
-	int power_val3;
-	bool isKiloWatts = 0;
-	bool isValid = 0;
 
-	// First decide if the power reading is kilo-watts or not
-	if (power > 1000 && power < 10000)
+	if ((change > powerManager.wakeThresholdWatts) || (-change > powerManager.wakeThresholdWatts))
 	{
-		isKiloWatts = 1;
-	        isValid = 1;
+		powerManager.referencePower = power;
+		powerManager.lastActivityMilliseconds = nowMilliseconds;
+		setPowerState(kSSD1331DisplayNormal);
+
+		return powerManager.state;
 	}
-	// Then see if it is in the usable watts range otherwise it is invalid
-	else if(power <= 1000 && power >= 0)
+
+	idleMilliseconds = nowMilliseconds - powerManager.lastActivityMilliseconds;
+	if ((powerManager.blankAfterMilliseconds > 0) && (idleMilliseconds >= powerManager.blankAfterMilliseconds))
 	{
-		isValid = 1;
-		
-		// Power below 1000W, so use cyan colour
-		numberColorR = 0x00;
-		numberColorG = 0x35;
-		numberColorB = 0x36;
+		setPowerState(kSSD1331DisplayBlank);
 	}
-	
-	// If it is in kilowatts get the first three significant figures
-	if (isKiloWatts && isValid)
+	else if ((powerManager.dimAfterMilliseconds > 0) && (idleMilliseconds >= powerManager.dimAfterMilliseconds))
 	{
-		power_val1 = power / 1000;
-	    	power_val2 = (power % 1000) / 100;
-		    power_val3 = (power % 100) / 10;
-		
-		numberColorR = 0x39;
-		numberColorG = 0x00;
-		numberColorB = 0x00;
-		
-	}       
-	// OtherbackgrColor[3] = {0x00, 0x00, 0x00};wise, if its valid, get all digits
-	else if (isValid)
-	{        
-		power_val1 = power / 100;
-		power_val2 = (power % 100) / 10;
-		power_val3 = power % 10;
-		
-	}
-	// Or just keep last value and don't print new numbers
-	else{return;}
-
-	
-	// Clear Screen 
-	writeCommand(kSSD1331CommandCLEAR);
-	writeCommand(0x00);
-	writeCommand(0x00);
-	writeCommand(0x5F);
-	writeCommand(0x3F);
-
-	// Set Background color (commented to save time since background assumed black)
-	//uint8_t line_buffer[8] = {0x22, 0x00, 0x00, 0x5F, 0x3F, backgrColorR, backgrColorG, backgrColorB};
-		
-	//writeLine(line_buffer);
-	
-	//writeColor(backgrColor, 3); // set background fill
-
-
-	// Draw Watts, W letter
-	writeWatts();
-	
-	if (isKiloWatts)
+		setPowerState(kSSD1331DisplayDim);
+	}
+
+	return powerManager.state;
+}
+
+void
+devSSD1331ConfigurePowerManager(uint16_t dimAfterSeconds, uint16_t blankAfterSeconds, uint16_t wakeThresholdWatts)
+{
+	powerManager.dimAfterMilliseconds	= (uint32_t)dimAfterSeconds * 1000;
+	powerManager.blankAfterMilliseconds	= (uint32_t)blankAfterSeconds * 1000;
+	powerManager.wakeThresholdWatts		= wakeThresholdWatts;
+	powerManager.lastActivityMilliseconds	= getMilliseconds();
+	setPowerState(kSSD1331DisplayNormal);
+}
+
+const SSD1331PowerManager *
+devSSD1331GetPowerManager(void)
+{
+	return &powerManager;
+}
+
+void
+devSSD1331ConfigureGovernor(uint8_t maxFramesPerSecond, uint16_t budgetMicroseconds)
+{
+	governor.frameIntervalMilliseconds	= 1000 / ((maxFramesPerSecond > 0) ? maxFramesPerSecond : 1);
+	governor.budgetMicroseconds		= budgetMicroseconds;
+	governor.debtMicroseconds		= 0;
+}
+
+/*
+ *	Submit the latest power value. A frame is drawn, with the average of
+ *	everything submitted since the last one, only once the frame interval
+ *	has passed and any SPI time debt is paid off. Returns true if a frame
+ *	was drawn.
+ */
+bool
+devSSD1331SubmitPower(int power)
+{
+	uint32_t	nowMilliseconds = getMilliseconds();
+	uint32_t	frameMicroseconds;
+	int		value;
+
+
+	governor.valuesSubmitted++;
+	governor.pendingSum += power;
+	governor.pendingCount++;
+
+	/*
+	 *	Nothing is drawn while blanked; the cells still hold what the panel
+	 *	shows, so the first frame after waking redraws whatever changed.
+	 */
+	if (updatePowerState(power, nowMilliseconds) == kSSD1331DisplayBlank)
+	{
+		governor.pendingSum = 0;
+		governor.pendingCount = 0;
+
+		return false;
+	}
+
+	if ((nowMilliseconds - governor.lastFrameMilliseconds) < governor.frameIntervalMilliseconds)
 	{
-		// Draw K for kilo 
-		writeKilo();
+		return false;
+	}
 
+	governor.lastFrameMilliseconds = nowMilliseconds;
 
-		// Decimal Point (with a rectangle)		
-		uint8_t line_buffer[8] = {0x22, 0x1A, 0x35, 0x1B, 0x36, numberColorR, numberColorG, numberColorB};
-		
-		writeLine(line_buffer);
-	
-		writeColor(backgrColor, 3); // set background fill
+	if (governor.debtMicroseconds > 0)
+	{
+		governor.debtMicroseconds -= governor.budgetMicroseconds;
+		governor.framesSkipped++;
 
+		return false;
 	}
-	
-	// Draw last number first as it is likely to change the most
-	drawNumber(power_val3, 0x34);	
-	drawNumber(power_val2, 0x1A);
-	drawNumber(power_val1, 0);
 
+	value = governor.pendingSum / governor.pendingCount;
+	governor.pendingSum = 0;
+	governor.pendingCount = 0;
 
-	
+	drawNumbersPower(value);
+	governor.framesRendered++;
+
+	/*
+	 *	Bytes go out at 8 bits per SPI clock: 8000 / kHz microseconds each.
+	 */
+	frameMicroseconds = frameBytes * 8000 / gWarpSpiBaudRateKbps;
+	if (frameMicroseconds > governor.budgetMicroseconds)
+	{
+		governor.debtMicroseconds += frameMicroseconds - governor.budgetMicroseconds;
+	}
+
+	return true;
+}
+
+const SSD1331Governor *
+devSSD1331GetGovernor(void)
+{
+	return &governor;
 }
@@ -7,12 +7,70 @@ typedef enum
 	kSSD1331ColororderRGB		= 1,
 	kSSD1331DelaysHWFILL		= 3,
 	kSSD1331DelaysHWLINE		= 1,
+
+	/*
+	 *	Commands batched per /CS transaction. A digit is at most 40 bytes.
+	 */
+	kSSD1331CommandBufferBytes	= 96,
+
+	/*
+	 *	Same urgency as INA219 acquisition (numerically above I2C0), so
+	 *	neither preempts the other.
+	 */
+	kSSD1331SpiIrqPriority		= 3,
+	kSSD1331TransferTimeoutMilliseconds	= 100,
+	kSSD1331ChipSelectSettleMicroseconds	= 1,
+
+	/*
+	 *	Glyphs are drawn on a 7x16 grid; the power digits use 3 pixels per
+	 *	grid unit (21x48 pixels).
+	 */
+	kSSD1331GlyphScaleDigit		= 3,
+	kSSD1331DigitCells		= 3,
+
+	/*
+	 *	Power history strip along the bottom rows, below the digits. One
+	 *	column per kSSD1331HistoryWindowsPerColumn calls, full height at
+	 *	kSSD1331HistoryFullScaleWatts.
+	 */
+	kSSD1331HistoryColumns		= 96,
+	kSSD1331HistoryTop		= 0x39,
+	kSSD1331HistoryBottom		= 0x3F,
+	kSSD1331HistoryWindowsPerColumn	= 20,
+	kSSD1331HistoryFullScaleWatts	= 1000,
+
+	/*
+	 *	Display governor defaults: 10 frames/s, and 2ms of SPI time per
+	 *	frame (50 bytes at 200kHz) sustained.
+	 */
+	kSSD1331GovernorDefaultFramesPerSecond	= 10,
+	kSSD1331GovernorDefaultBudgetMicroseconds	= 2000,
+
+	/*
+	 *	Display power manager defaults: dim after 30s without a change of
+	 *	more than 50W, blank after 5 minutes.
+	 */
+	kSSD1331PowerDefaultDimAfterSeconds	= 30,
+	kSSD1331PowerDefaultBlankAfterSeconds	= 300,
+	kSSD1331PowerDefaultWakeThresholdWatts	= 50,
+
+	/*
+	 *	POWERMODE arguments, and the contrasts and precharge used in dim mode
+	 *	(half the normal contrasts set in devSSD1331init()).
+	 */
+	kSSD1331PowerModeSave		= 0x1A,
+	kSSD1331PowerModeNormal		= 0x0B,
+	kSSD1331DimContrastA		= 0x48,
+	kSSD1331DimContrastB		= 0x7F,
+	kSSD1331DimContrastC		= 0x3E,
+	kSSD1331DimPrecharge		= 0x0F,
 } SSD1331Constants;
 
 typedef enum
 {
 	kSSD1331CommandDRAWLINE		= 0x21,
 	kSSD1331CommandDRAWRECT		= 0x22,
+	kSSD1331CommandCOPY		= 0x23,
 	kSSD1331CommandCLEAR		= 0x25,
 	kSSD1331CommandFILL		= 0x26,
 	kSSD1331CommandSETCOLUMN	= 0x15,
@@ -26,6 +84,8 @@ typedef enum
 	kSSD1331CommandDISPLAYOFFSET	= 0xA2,
 	kSSD1331CommandNORMALDISPLAY	= 0xA4,
 	kSSD1331CommandDISPLAYALLON	= 0xA5,
+	kSSD1331CommandDIMMODESETTING	= 0xAB,
+	kSSD1331CommandDISPLAYDIM	= 0xAC,
 	kSSD1331CommandDISPLAYALLOFF	= 0xA6,
 	kSSD1331CommandINVERTDISPLAY	= 0xA7,
 	kSSD1331CommandSETMULTIPLEX	= 0xA8,
@@ -42,4 +102,142 @@ typedef enum
 	kSSD1331CommandVCOMH		= 0xBE,
 } SSD1331Commands;
 
-int	devSSD1331init(void);
+/*
+ *	Regions of the power display that are redrawn independently. Digits are
+ *	listed least significant first, which is also the redraw order, since
+ *	the last digit changes most often. The decimal points sit in the gaps
+ *	after the left and middle digits.
+ */
+typedef enum
+{
+	kSSD1331CellDigitRight,
+	kSSD1331CellDigitMiddle,
+	kSSD1331CellDigitLeft,
+	kSSD1331CellPointMiddle,
+	kSSD1331CellPointLeft,
+	kSSD1331CellUnit,
+	kSSD1331CellCount,
+} SSD1331Cells;
+
+typedef enum
+{
+	/*
+	 *	Cell contents: the character ('0'-'9' or '-') for digits,
+	 *	kSSD1331CellShown for a decimal point, kSSD1331CellWatts or
+	 *	kSSD1331CellKiloWatts for the unit.
+	 */
+	kSSD1331CellWatts		= 0,
+	kSSD1331CellKiloWatts		= 1,
+	kSSD1331CellShown		= 1,
+	kSSD1331CellBlank		= 0xFF,
+} SSD1331CellContents;
+
+typedef enum
+{
+	kSSD1331GlyphFilled		= (1 << 0),
+} SSD1331GlyphFlags;
+
+/*
+ *	A glyph stroke point is one byte: one of these x coordinates in the top
+ *	three bits, or'd with y (0-16, downwards) in the rest.
+ */
+typedef enum
+{
+	kSSD1331GlyphX0			= (0 << 5),
+	kSSD1331GlyphX1			= (1 << 5),
+	kSSD1331GlyphX2			= (2 << 5),
+	kSSD1331GlyphX3			= (3 << 5),
+	kSSD1331GlyphX4			= (4 << 5),
+	kSSD1331GlyphX5			= (5 << 5),
+	kSSD1331GlyphX6			= (6 << 5),
+	kSSD1331GlyphX7			= (7 << 5),
+	kSSD1331GlyphYMask		= 0x1F,
+} SSD1331GlyphPoints;
+
+/*
+ *	One character: strokes [firstStroke, firstStroke + strokeCount) of the
+ *	stroke table, the first rectangleCount of them rectangles.
+ */
+typedef struct
+{
+	char		character;
+	uint8_t		width;
+	uint8_t		firstStroke;
+	uint8_t		rectangleCount;
+	uint8_t		strokeCount;
+	uint8_t		flags;
+} SSD1331Glyph;
+
+/*
+ *	Decouples display refresh from the rate power values are submitted.
+ *	Values arriving between frames are averaged into the next frame, and
+ *	frames that overrun the SPI time budget run up debt that is paid off by
+ *	skipping later frame slots.
+ */
+typedef struct
+{
+	uint16_t	frameIntervalMilliseconds;
+	uint16_t	budgetMicroseconds;
+
+	uint32_t	lastFrameMilliseconds;
+	int32_t		debtMicroseconds;
+	int32_t		pendingSum;
+	uint16_t	pendingCount;
+
+	uint32_t	valuesSubmitted;
+	uint32_t	framesRendered;
+	uint32_t	framesSkipped;
+} SSD1331Governor;
+
+typedef enum
+{
+	kSSD1331DisplayNormal,
+	kSSD1331DisplayDim,
+	kSSD1331DisplayBlank,
+} SSD1331DisplayPowerState;
+
+/*
+ *	Dims the panel once readings have been stable for dimAfterMilliseconds
+ *	and blanks it (display off, power save) after blankAfterMilliseconds.
+ *	Any reading more than wakeThresholdWatts from the last significant one
+ *	restores it immediately. A zero period disables that step.
+ */
+typedef struct
+{
+	uint32_t	dimAfterMilliseconds;
+	uint32_t	blankAfterMilliseconds;
+	uint16_t	wakeThresholdWatts;
+
+	SSD1331DisplayPowerState	state;
+	int		referencePower;
+	uint32_t	lastActivityMilliseconds;
+
+	uint32_t	dimCount;
+	uint32_t	blankCount;
+	uint32_t	wakeCount;
+} SSD1331PowerManager;
+
+/*
+ *	What is currently on the panel in one cell.
+ */
+typedef struct
+{
+	uint8_t		content;
+	uint8_t		color[3];
+} SSD1331Cell;
+
+int		devSSD1331init(void);
+void		devSSD1331ClearScreen(void);
+void		drawNumbersPower(int power);
+uint32_t	devSSD1331GetFrameBytes(void);
+uint32_t	devSSD1331GetFrameBusyMicroseconds(void);
+void		devSSD1331SetNonBlocking(bool nonBlocking);
+int		devSSD1331WaitForTransfer(void);
+uint8_t		devSSD1331DrawGlyph(char character, uint8_t x, uint8_t y, uint8_t scale);
+uint8_t		devSSD1331DrawText(const char *  text, uint8_t x, uint8_t y, uint8_t scale);
+void		devSSD1331PushHistory(int power);
+void		devSSD1331ConfigureGovernor(uint8_t maxFramesPerSecond, uint16_t budgetMicroseconds);
+bool		devSSD1331SubmitPower(int power);
+const SSD1331Governor *	devSSD1331GetGovernor(void);
+void		devSSD1331ConfigurePowerManager(uint16_t dimAfterSeconds, uint16_t blankAfterSeconds, uint16_t wakeThresholdWatts);
+const SSD1331PowerManager *	devSSD1331GetPowerManager(void);
@@ -0,0 +1,340 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "warp.h"
+#include "devINA219.h"
+
+
+/*
+ *	Host test for the INA219 acquisition engine.
+ *
+ *	acquisitionSampleINA219() (the body of the TPM0 ISR) is called once per
+ *	simulated sample period against a model of the INA219's registers: the
+ *	chip converts continuously, sets CNVR in the bus voltage register when
+ *	a conversion completes, and clears it when the power register is read.
+ *	The shunt voltage register returns the number of the period in which it
+ *	was read, so a window's samples show directly which periods they came
+ *	from, and any gap in them is a period lost.
+ */
+
+volatile WarpI2CDeviceState			deviceINA219State;
+volatile WarpINA219AcquisitionState		deviceINA219AcquisitionState;
+volatile uint32_t				gWarpI2cBaudRateKbps = 200;
+
+typedef struct
+{
+	uint32_t	samplePeriodMicroseconds;
+	uint32_t	conversionMicroseconds;
+	uint32_t	nowMicroseconds;
+	uint32_t	period;
+	uint32_t	conversionsCleared;
+
+	/*
+	 *	The shunt voltage read in this period fails (0 for none).
+	 */
+	uint32_t	failingPeriod;
+} FakeINA219;
+
+typedef struct
+{
+	uint32_t	windowsSeen;
+	uint32_t	windowsContiguous;
+	uint32_t	windowsUneven;
+	uint32_t	windowsBadlyFlagged;
+	int16_t		lastSample;
+} WindowChecks;
+
+static FakeINA219	fake;
+static int		failures;
+
+#define CHECK(condition)	check((condition), #condition, __LINE__)
+
+
+
+static void
+check(bool passed, const char *  description, int line)
+{
+	if (!passed)
+	{
+		printf("test-acquisition.c:%d: FAILED: %s\n", line, description);
+		failures++;
+	}
+}
+
+WarpStatus
+warpRegmapRead(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t deviceRegister, int numberOfBytes)
+{
+	uint32_t	conversionsDone = fake.nowMicroseconds / fake.conversionMicroseconds;
+
+	switch (deviceRegister)
+	{
+		case kWarpINA219RegisterBusVoltage:
+		{
+			deviceStatePointer->i2cBuffer[0] = 0;
+			deviceStatePointer->i2cBuffer[1] = (conversionsDone > fake.conversionsCleared) ? kWarpINA219BusVoltageConversionReadyBit : 0;
+			break;
+		}
+
+		case kWarpINA219RegisterShuntVoltage:
+		{
+			if (fake.period == fake.failingPeriod)
+			{
+				return kWarpStatusDeviceCommunicationFailed;
+			}
+
+			deviceStatePointer->i2cBuffer[0] = fake.period >> 8;
+			deviceStatePointer->i2cBuffer[1] = fake.period & 0xFF;
+			break;
+		}
+
+		case kWarpINA219RegisterPower:
+		{
+			fake.conversionsCleared = conversionsDone;
+			break;
+		}
+
+		default:
+		{
+			return kWarpStatusBadDeviceCommand;
+		}
+	}
+
+	return kWarpStatusOK;
+}
+
+/*
+ *	What startAcquisitionINA219() sets up, less the timer.
+ */
+static void
+resetAcquisition(uint32_t samplePeriodMicroseconds, uint32_t conversionMicroseconds)
+{
+	memset((void *)&deviceINA219AcquisitionState, 0, sizeof(deviceINA219AcquisitionState));
+	deviceINA219AcquisitionState.gapPending			= true;
+	deviceINA219AcquisitionState.samplePeriodMicroseconds	= samplePeriodMicroseconds;
+	deviceINA219AcquisitionState.running			= true;
+
+	memset(&fake, 0, sizeof(fake));
+	fake.samplePeriodMicroseconds	= samplePeriodMicroseconds;
+	fake.conversionMicroseconds	= conversionMicroseconds;
+}
+
+/*
+ *	As main() does: take the ready window, if any, check it and give it
+ *	back. Every window must hold consecutive periods, and the gap flag
+ *	must say whether it follows on from the last window taken.
+ */
+static void
+serviceWindow(WindowChecks *  checks, bool allowRepeats)
+{
+	volatile int16_t *	window = getReadyWindowINA219();
+	bool			contiguous;
+
+	if (window == NULL)
+	{
+		return;
+	}
+
+	contiguous = getReadyWindowContiguousINA219();
+
+	for (int i = 1; i < kWarpSizesINA219WindowSamples; i++)
+	{
+		int		step = window[i] - window[i - 1];
+
+		if ((step != 1) && !(allowRepeats && ((step == 0) || (step == 2))))
+		{
+			checks->windowsUneven++;
+			break;
+		}
+	}
+
+	if ((checks->windowsSeen > 0) && (contiguous != (window[0] == checks->lastSample + 1)))
+	{
+		checks->windowsBadlyFlagged++;
+	}
+
+	checks->windowsSeen++;
+	checks->windowsContiguous += contiguous;
+	checks->lastSample = window[kWarpSizesINA219WindowSamples - 1];
+
+	releaseWindowINA219();
+}
+
+/*
+ *	Run for the given number of sample periods. main() looks for a window
+ *	once every servicePeriods periods.
+ */
+static void
+runPeriods(uint32_t periods, uint32_t servicePeriods, WindowChecks *  checks, bool allowRepeats)
+{
+	for (uint32_t i = 0; i < periods; i++)
+	{
+		fake.period++;
+		fake.nowMicroseconds += fake.samplePeriodMicroseconds;
+		acquisitionSampleINA219();
+
+		if ((fake.period % servicePeriods) == 0)
+		{
+			serviceWindow(checks, allowRepeats);
+		}
+	}
+}
+
+/*
+ *	Every period either lands in a window (ready, dropped or still
+ *	filling), was not ready, was missed with no ISR, or was discarded with
+ *	a failed window.
+ */
+static bool
+periodsAccountedFor(uint32_t periods)
+{
+	volatile WarpINA219AcquisitionState *	acquisition = &deviceINA219AcquisitionState;
+
+	return	(acquisition->windowsCompleted + acquisition->windowsDropped) * kWarpSizesINA219WindowSamples
+		+ acquisition->conversionsNotReady
+		+ acquisition->periodsMissed
+		+ acquisition->samplesDiscarded
+		+ acquisition->fillIndex == periods;
+}
+
+/*
+ *	The sample period startAcquisitionINA219() picks for a 12-bit shunt
+ *	conversion (532us typical), against a chip at the datasheet's slowest
+ *	(586us): every period must have a conversion, and no window may be
+ *	lost.
+ */
+static void
+testSteadyAcquisition(void)
+{
+	WindowChecks	checks = {0};
+	uint32_t	periods = 200 * kWarpSizesINA219WindowSamples;
+
+	resetAcquisition((532 * (100 + kWarpINA219ConversionMarginPercent)) / 100, 586);
+	runPeriods(periods, 1, &checks, false);
+
+	CHECK(deviceINA219AcquisitionState.windowsCompleted == 200);
+	CHECK(deviceINA219AcquisitionState.windowsDropped == 0);
+	CHECK(deviceINA219AcquisitionState.windowsFailed == 0);
+	CHECK(deviceINA219AcquisitionState.conversionsNotReady == 0);
+	CHECK(deviceINA219AcquisitionState.readsFailed == 0);
+	CHECK(checks.windowsSeen == 200);
+	CHECK(checks.windowsUneven == 0);
+	CHECK(checks.windowsBadlyFlagged == 0);
+	CHECK(checks.windowsContiguous == 199);
+	CHECK(periodsAccountedFor(periods));
+}
+
+/*
+ *	A period just short of the chip's conversion time finds CNVR clear
+ *	every few hundred periods. The windows those land in must be thrown
+ *	away, not handed over with a period missing.
+ */
+static void
+testMissedConversions(void)
+{
+	WindowChecks	checks = {0};
+	uint32_t	periods = 200 * kWarpSizesINA219WindowSamples;
+
+	resetAcquisition(584, 586);
+	runPeriods(periods, 1, &checks, false);
+
+	CHECK(deviceINA219AcquisitionState.conversionsNotReady > 0);
+	CHECK(deviceINA219AcquisitionState.windowsFailed > 0);
+	CHECK(deviceINA219AcquisitionState.windowsFailed <= deviceINA219AcquisitionState.conversionsNotReady);
+	CHECK(deviceINA219AcquisitionState.windowsCompleted > 0);
+	CHECK(deviceINA219AcquisitionState.windowsDropped == 0);
+	CHECK(checks.windowsUneven == 0);
+	CHECK(checks.windowsBadlyFlagged == 0);
+	CHECK(checks.windowsContiguous < checks.windowsSeen);
+	CHECK(periodsAccountedFor(periods));
+}
+
+/*
+ *	main() taking longer than a window to come back: the filling window
+ *	is dropped rather than overwriting the one main() holds, and the next
+ *	window handed over is marked as following a gap.
+ */
+static void
+testSlowConsumer(void)
+{
+	WindowChecks	checks = {0};
+	uint32_t	periods = 60 * kWarpSizesINA219WindowSamples;
+
+	resetAcquisition(1000, 532);
+	runPeriods(periods, 3 * kWarpSizesINA219WindowSamples, &checks, false);
+
+	CHECK(deviceINA219AcquisitionState.windowsDropped > 0);
+	CHECK(deviceINA219AcquisitionState.windowsCompleted == checks.windowsSeen);
+	CHECK(deviceINA219AcquisitionState.windowsFailed == 0);
+	CHECK(checks.windowsUneven == 0);
+	CHECK(checks.windowsBadlyFlagged == 0);
+	CHECK(checks.windowsContiguous == 0);
+	CHECK(periodsAccountedFor(periods));
+}
+
+/*
+ *	A failed read repeats the previous sample, so the window keeps its
+ *	length and spacing.
+ */
+static void
+testFailedRead(void)
+{
+	WindowChecks	checks = {0};
+	uint32_t	periods = 4 * kWarpSizesINA219WindowSamples;
+
+	resetAcquisition(1000, 532);
+	fake.failingPeriod = kWarpSizesINA219WindowSamples + 10;
+	runPeriods(periods, 1, &checks, true);
+
+	CHECK(deviceINA219AcquisitionState.readsFailed == 1);
+	CHECK(deviceINA219AcquisitionState.windowsCompleted == 4);
+	CHECK(deviceINA219AcquisitionState.windowsFailed == 0);
+	CHECK(checks.windowsUneven == 0);
+	CHECK(checks.windowsContiguous == 3);
+	CHECK(periodsAccountedFor(periods));
+}
+
+/*
+ *	Interrupts masked for several periods part way through a window (a
+ *	flash erase): the partial window is thrown away, the lost periods are
+ *	counted, and the next window handed over is marked as following a gap.
+ */
+static void
+testMaskedPeriods(void)
+{
+	WindowChecks	checks = {0};
+	uint32_t	periods = 4 * kWarpSizesINA219WindowSamples;
+	uint32_t	missed = 20;
+
+	resetAcquisition(1000, 532);
+	runPeriods(kWarpSizesINA219WindowSamples + 10, 1, &checks, false);
+
+	fake.period += missed;
+	fake.nowMicroseconds += missed * fake.samplePeriodMicroseconds;
+	acquisitionMissedPeriodsINA219(missed);
+
+	runPeriods(periods - (kWarpSizesINA219WindowSamples + 10), 1, &checks, false);
+
+	CHECK(deviceINA219AcquisitionState.periodsMissed == missed);
+	CHECK(deviceINA219AcquisitionState.windowsFailed == 1);
+	CHECK(deviceINA219AcquisitionState.samplesDiscarded == 10);
+	CHECK(checks.windowsUneven == 0);
+	CHECK(checks.windowsBadlyFlagged == 0);
+	CHECK(checks.windowsContiguous == checks.windowsSeen - 2);
+	CHECK(periodsAccountedFor(periods + missed));
+}
+
+int
+main(void)
+{
+	testSteadyAcquisition();
+	testMissedConversions();
+	testSlowConsumer();
+	testFailedRead();
+	testMaskedPeriods();
+
+	printf("test-acquisition: %s\n", (failures == 0) ? "passed" : "FAILED");
+
+	return (failures == 0) ? 0 : 1;
+}
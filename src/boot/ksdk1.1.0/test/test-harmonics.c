@@ -0,0 +1,254 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "warp.h"
+
+
+/*
+ *	Host correctness test and benchmark for the Goertzel harmonic analyser.
+ *
+ *	Synthetic waveforms with known harmonic amplitudes go through the
+ *	filters, both with a whole number of samples per cycle (every harmonic
+ *	on a bin centre) and, as on the device, through the cycle RMS tracker
+ *	at a sample rate that does not divide the mains period.
+ */
+
+enum
+{
+	kBenchmarkBlocks	= 20000,
+};
+
+/*
+ *	Peak amplitudes in register LSBs, fundamental first, then the 3rd,
+ *	5th, 7th and 9th.
+ */
+static const double	amplitudes[kWarpHarmonicsCount] = {10000, 2000, 1000, 500, 250};
+static const double	phases[kWarpHarmonicsCount] = {0.3, 1.1, 2.0, 0.7, 2.9};
+
+static int		failures;
+
+#define CHECK(condition)	check((condition), #condition, __LINE__)
+
+
+
+static void
+check(bool passed, const char *  description, int line)
+{
+	if (!passed)
+	{
+		printf("test-harmonics.c:%d: FAILED: %s\n", line, description);
+		failures++;
+	}
+}
+
+static uint64_t
+nanoseconds(void)
+{
+	struct timespec		now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*
+ *	The waveform at a time in mains cycles, optionally with a 2nd harmonic
+ *	(which the odd-harmonic bins must not pick up).
+ */
+static int32_t
+waveform(double cycles, double secondHarmonic)
+{
+	double		value = secondHarmonic * sin(2 * M_PI * 2 * cycles);
+
+	for (int i = 0; i < kWarpHarmonicsCount; i++)
+	{
+		value += amplitudes[i] * sin(2 * M_PI * (2 * i + 1) * cycles + phases[i]);
+	}
+
+	return (int32_t)lround(value);
+}
+
+static double
+referenceThdPerMille(uint8_t harmonicsInBand)
+{
+	double		harmonicPower = 0;
+
+	for (int i = 1; i < harmonicsInBand; i++)
+	{
+		harmonicPower += amplitudes[i] * amplitudes[i];
+	}
+
+	return 1000 * sqrt(harmonicPower) / amplitudes[0];
+}
+
+/*
+ *	The quarter-wave polynomial's worst case over every angle, against
+ *	libm, must stay at the 2e-4 its comment claims (plus half a Q14 LSB of
+ *	output rounding).
+ */
+static void
+testCosine(void)
+{
+	double		worstError = 0;
+
+	for (uint32_t angle = 0; angle < 0x10000; angle++)
+	{
+		double	error = fabs(warpCosineQ14((uint16_t)angle) / 16384.0 - cos(2 * M_PI * angle / 65536.0));
+
+		if (error > worstError)
+		{
+			worstError = error;
+		}
+	}
+
+	printf("test-harmonics: warpCosineQ14 worst-case error %.2e\n", worstError);
+
+	CHECK(worstError < 2e-4 + 0.5 / 16384);
+	CHECK(warpCosineQ14(0) == 16384);
+	CHECK(warpCosineQ14(0x4000) == 0);
+	CHECK(warpCosineQ14(0x8000) == -16384);
+	CHECK(warpCosineQ14(0xC000) == 0);
+}
+
+/*
+ *	20 samples per cycle (50Hz at 1kHz) over the five cycles the cycle RMS
+ *	delivers: every harmonic up to the 9th is on a bin centre and in band,
+ *	so each bin should read its harmonic's amplitude to within the
+ *	coefficient quantisation.
+ */
+static void
+testBinCentred(void)
+{
+	WarpHarmonicAnalyser	analyser = {0};
+	uint32_t		samplesPerCycle = 20;
+
+	warpHarmonicsTune(&analyser, samplesPerCycle * 256);
+	CHECK(analyser.harmonicsInBand == kWarpHarmonicsCount);
+
+	for (uint32_t i = 0; i < samplesPerCycle * kWarpCycleRmsCyclesPerResult; i++)
+	{
+		warpHarmonicsAddSample(&analyser, waveform((double)i / samplesPerCycle, 1500 /* secondHarmonic */));
+	}
+
+	CHECK(warpHarmonicsFinish(&analyser));
+	CHECK(!analyser.tuned);
+	CHECK(analyser.resultCount == 1);
+
+	for (int i = 0; i < kWarpHarmonicsCount; i++)
+	{
+		double	measured = analyser.amplitudeQ8[i] / 256.0;
+
+		printf("test-harmonics: bin-centred harmonic %d: %.1f (expected %.0f)\n", 2 * i + 1, measured, amplitudes[i]);
+		CHECK(fabs(measured - amplitudes[i]) < 0.005 * amplitudes[i] + 2);
+	}
+
+	CHECK(fabs(analyser.thdPerMille - referenceThdPerMille(kWarpHarmonicsCount)) <= 2);
+
+	/*
+	 *	No block in progress: nothing to report.
+	 */
+	CHECK(!warpHarmonicsFinish(&analyser));
+}
+
+/*
+ *	As the boot loop drives it: 50Hz sampled every 1.41ms (the bus-limited
+ *	period at 200kHz), so a cycle is about 14.18 samples and the blocks
+ *	the cycle RMS delimits have fractional-sample edges. Only the
+ *	harmonics below kWarpHarmonicsMaxTurnsQ16 are analysed.
+ */
+static void
+testThroughCycleRms(void)
+{
+	WarpCycleRmsAccumulator	cycleRms;
+	WarpHarmonicAnalyser	analyser = {0};
+	double			samplePeriodCycles = 1410e-6 * 50;
+	uint32_t		results = 0;
+	uint32_t		worstPerMille = 0;
+
+	warpCycleRmsReset(&cycleRms);
+
+	for (uint32_t i = 0; i < 4000; i++)
+	{
+		int32_t		sample = waveform(i * samplePeriodCycles, 0);
+
+		if (warpCycleRmsAddSample(&cycleRms, sample))
+		{
+			if (warpHarmonicsFinish(&analyser))
+			{
+				for (int h = 0; h < analyser.harmonicsInBand; h++)
+				{
+					uint32_t	errorPerMille = (uint32_t)(1000 * fabs(analyser.amplitudeQ8[h] / 256.0 - amplitudes[h]) / amplitudes[0]);
+
+					if (errorPerMille > worstPerMille)
+					{
+						worstPerMille = errorPerMille;
+					}
+				}
+				results++;
+			}
+			warpHarmonicsTune(&analyser, cycleRms.resultLocked ? cycleRms.periodQ8 : 0);
+		}
+
+		if (analyser.tuned)
+		{
+			warpHarmonicsAddSample(&analyser, sample);
+		}
+	}
+
+	printf("test-harmonics: at 1.41ms, %u blocks, %u harmonics in band, worst error %u/1000 of the fundamental\n",
+		results, analyser.harmonicsInBand, worstPerMille);
+
+	CHECK(cycleRms.resultLocked);
+	CHECK(results > 50);
+	CHECK(analyser.harmonicsInBand == 3);
+	CHECK(worstPerMille <= 20);
+}
+
+static void
+benchmark(void)
+{
+	WarpHarmonicAnalyser	analyser = {0};
+	int32_t			samples[100];
+	volatile uint32_t	sink = 0;
+	uint64_t		start;
+	uint64_t		elapsed;
+
+	for (int i = 0; i < 100; i++)
+	{
+		samples[i] = waveform(i / 20.0, 0);
+	}
+
+	start = nanoseconds();
+	for (uint32_t block = 0; block < kBenchmarkBlocks; block++)
+	{
+		warpHarmonicsTune(&analyser, 20 * 256);
+		for (int i = 0; i < 100; i++)
+		{
+			warpHarmonicsAddSample(&analyser, samples[i]);
+		}
+		warpHarmonicsFinish(&analyser);
+		sink += analyser.thdPerMille;
+	}
+	elapsed = nanoseconds() - start;
+
+	printf("test-harmonics: %d harmonics, 100-sample block (tune, add, finish): %.1fns, %.1fns per sample\n",
+		kWarpHarmonicsCount,
+		(double)elapsed / kBenchmarkBlocks,
+		(double)elapsed / kBenchmarkBlocks / 100);
+}
+
+int
+main(void)
+{
+	testCosine();
+	testBinCentred();
+	testThroughCycleRms();
+	benchmark();
+
+	printf("test-harmonics: %s\n", (failures == 0) ? "passed" : "FAILED");
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,341 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "warp.h"
+
+
+/*
+ *	Host accuracy test and benchmark for the integer RMS and power path,
+ *	against libm sqrt() and a double-precision RMS. Inputs are random, plus
+ *	the edge cases: zero, one, and full scale (a 16-bit sample of -32768,
+ *	the largest 64-bit value, the largest Q16 scale factor).
+ *
+ *	The benchmark times the old double-precision window RMS against the
+ *	integer one. On the host, with an FPU, the double version wins; on the
+ *	M0+ every double operation is a soft-float library call. The figures
+ *	are for spotting regressions in the integer path, not for comparing
+ *	against the target.
+ */
+
+enum
+{
+	kRandomValues		= 1000000,
+	kRandomWindows		= 20000,
+	kBenchmarkWindows	= 200000,
+};
+
+static int		failures;
+static uint64_t		randomState = 0x2545F4914F6CDD1DULL;
+
+#define CHECK(condition)	check((condition), #condition, __LINE__)
+
+
+
+static void
+check(bool passed, const char *  description, int line)
+{
+	if (!passed)
+	{
+		printf("test-rms.c:%d: FAILED: %s\n", line, description);
+		failures++;
+	}
+}
+
+/*
+ *	xorshift64*: repeatable from run to run, unlike rand().
+ */
+static uint64_t
+randomValue(void)
+{
+	randomState ^= randomState >> 12;
+	randomState ^= randomState << 25;
+	randomState ^= randomState >> 27;
+
+	return randomState * 0x2545F4914F6CDD1DULL;
+}
+
+static int16_t
+randomSample(void)
+{
+	return (int16_t)randomValue();
+}
+
+static uint64_t
+nanoseconds(void)
+{
+	struct timespec		now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*
+ *	floor(sqrt(value)) is the r with r^2 <= value < (r + 1)^2, checked in
+ *	128 bits so that the edge cases cannot overflow the check itself.
+ */
+static bool
+isFloorSquareRoot(uint64_t value, uint32_t root)
+{
+	unsigned __int128	r = root;
+
+	return (r * r <= value) && ((r + 1) * (r + 1) > value);
+}
+
+static void
+testSquareRoot(void)
+{
+	static const uint64_t	edges[] =
+	{
+		0, 1, 2, 3, 4, 15, 16, 17,
+		(uint64_t)UINT32_MAX * UINT32_MAX - 1,
+		(uint64_t)UINT32_MAX * UINT32_MAX,
+		(uint64_t)UINT32_MAX * UINT32_MAX + 1,
+		(uint64_t)1 << 62,
+		UINT64_MAX,
+	};
+	uint32_t		mismatches = 0;
+	uint32_t		libmMismatches = 0;
+
+	for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+	{
+		CHECK(isFloorSquareRoot(edges[i], warpSquareRoot64(edges[i])));
+	}
+
+	CHECK(warpSquareRoot64(0) == 0);
+	CHECK(warpSquareRoot64(1) == 1);
+	CHECK(warpSquareRoot64(UINT64_MAX) == UINT32_MAX);
+
+	for (uint32_t i = 0; i < kRandomValues; i++)
+	{
+		/*
+		 *	Spread the values over every magnitude, not just the top bits.
+		 */
+		uint64_t	value = randomValue() >> (randomValue() % 64);
+		uint32_t	root = warpSquareRoot64(value);
+
+		mismatches += !isFloorSquareRoot(value, root);
+
+		/*
+		 *	libm only agrees to within rounding above 2^53.
+		 */
+		if (value < ((uint64_t)1 << 52))
+		{
+			libmMismatches += (root != (uint32_t)floor(sqrt((double)value)));
+		}
+	}
+
+	CHECK(mismatches == 0);
+	CHECK(libmMismatches == 0);
+}
+
+/*
+ *	RMS in Q8 from a double-precision sum of squares, as the main loop
+ *	used to compute it (less the truncating divide).
+ */
+static double
+referenceRmsQ8(const int16_t *  samples, int count)
+{
+	double		sumOfSquares = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		sumOfSquares += (double)samples[i] * samples[i];
+	}
+
+	return sqrt(sumOfSquares / count) * 256;
+}
+
+static uint32_t
+integerRmsQ8(const int16_t *  samples, int count)
+{
+	WarpRmsAccumulator	accumulator;
+
+	warpRmsReset(&accumulator);
+	for (int i = 0; i < count; i++)
+	{
+		warpRmsAddSample(&accumulator, samples[i]);
+	}
+
+	return warpRmsGetQ8(&accumulator);
+}
+
+/*
+ *	The integer RMS floors twice (the divide and the root), so it may sit
+ *	up to one Q8 LSB below the exact value, but never above it.
+ */
+static bool
+rmsWithinOneLsb(const int16_t *  samples, int count)
+{
+	double		error = referenceRmsQ8(samples, count) - integerRmsQ8(samples, count);
+
+	return (error > -1e-6) && (error < 1 + 1e-6);
+}
+
+static void
+testRms(void)
+{
+	int16_t			samples[kWarpSizesINA219WindowSamples];
+	WarpRmsAccumulator	empty;
+	uint32_t		outOfTolerance = 0;
+
+	warpRmsReset(&empty);
+	CHECK(warpRmsGetQ8(&empty) == 0);
+
+	for (int i = 0; i < kWarpSizesINA219WindowSamples; i++)
+	{
+		samples[i] = 0;
+	}
+	CHECK(integerRmsQ8(samples, kWarpSizesINA219WindowSamples) == 0);
+
+	samples[0] = 1;
+	CHECK(integerRmsQ8(samples, 1) == 256);
+	CHECK(rmsWithinOneLsb(samples, kWarpSizesINA219WindowSamples));
+
+	for (int i = 0; i < kWarpSizesINA219WindowSamples; i++)
+	{
+		samples[i] = -32768;
+	}
+	CHECK(integerRmsQ8(samples, kWarpSizesINA219WindowSamples) == 32768 * 256);
+
+	for (int i = 0; i < kWarpSizesINA219WindowSamples; i++)
+	{
+		samples[i] = (i & 1) ? 32767 : -32768;
+	}
+	CHECK(rmsWithinOneLsb(samples, kWarpSizesINA219WindowSamples));
+
+	/*
+	 *	Small currents: the old per-term divide by the sample count made
+	 *	these zero.
+	 */
+	for (int i = 0; i < kWarpSizesINA219WindowSamples; i++)
+	{
+		samples[i] = (i % 3) - 1;
+	}
+	CHECK(integerRmsQ8(samples, kWarpSizesINA219WindowSamples) > 0);
+	CHECK(rmsWithinOneLsb(samples, kWarpSizesINA219WindowSamples));
+
+	for (uint32_t window = 0; window < kRandomWindows; window++)
+	{
+		int	count = 1 + randomValue() % kWarpSizesINA219WindowSamples;
+		int	shift = randomValue() % 16;
+
+		for (int i = 0; i < count; i++)
+		{
+			samples[i] = randomSample() >> shift;
+		}
+
+		outOfTolerance += !rmsWithinOneLsb(samples, count);
+	}
+
+	CHECK(outOfTolerance == 0);
+}
+
+/*
+ *	Round-to-nearest of rmsQ8 * scaleQ16 / 2^24, in long double (exact for
+ *	these products), saturating as warpPowerFromRmsQ8() does.
+ */
+static int64_t
+referencePower(uint32_t rmsQ8, uint32_t scaleQ16)
+{
+	long double	power = floorl(((long double)rmsQ8 * scaleQ16) / 16777216.0L + 0.5L);
+
+	return (power > INT32_MAX) ? INT32_MAX : (int64_t)power;
+}
+
+static void
+testPower(void)
+{
+	static const uint32_t	rmsEdges[] = {0, 1, 127, 128, 255, 256, 32768 * 256, UINT32_MAX};
+	static const uint32_t	scaleEdges[] = {0, 1, 65535, 65536, kWarpPowerScaleQ16Display, kWarpPowerScaleQ16CsvStream, UINT32_MAX};
+	uint32_t		mismatches = 0;
+
+	for (size_t i = 0; i < sizeof(rmsEdges) / sizeof(rmsEdges[0]); i++)
+	{
+		for (size_t j = 0; j < sizeof(scaleEdges) / sizeof(scaleEdges[0]); j++)
+		{
+			CHECK(warpPowerFromRmsQ8(rmsEdges[i], scaleEdges[j]) == referencePower(rmsEdges[i], scaleEdges[j]));
+		}
+	}
+
+	/*
+	 *	One LSB at unit scale is one watt; half an LSB rounds up.
+	 */
+	CHECK(warpPowerFromRmsQ8(256, 65536) == 1);
+	CHECK(warpPowerFromRmsQ8(128, 65536) == 1);
+	CHECK(warpPowerFromRmsQ8(127, 65536) == 0);
+	CHECK(warpPowerFromRmsQ8(UINT32_MAX, UINT32_MAX) == INT32_MAX);
+
+	for (uint32_t i = 0; i < kRandomValues; i++)
+	{
+		uint32_t	rmsQ8 = (uint32_t)randomValue() >> (randomValue() % 32);
+		uint32_t	scaleQ16 = (uint32_t)randomValue() >> (randomValue() % 32);
+
+		mismatches += (warpPowerFromRmsQ8(rmsQ8, scaleQ16) != referencePower(rmsQ8, scaleQ16));
+	}
+
+	CHECK(mismatches == 0);
+}
+
+static void
+benchmark(void)
+{
+	static int16_t		windows[64][kWarpSizesINA219WindowSamples];
+	volatile double		doubleSink = 0;
+	volatile uint32_t	integerSink = 0;
+	uint64_t		start;
+	uint64_t		doubleNanoseconds;
+	uint64_t		integerNanoseconds;
+
+	for (int window = 0; window < 64; window++)
+	{
+		for (int i = 0; i < kWarpSizesINA219WindowSamples; i++)
+		{
+			windows[window][i] = randomSample();
+		}
+	}
+
+	start = nanoseconds();
+	for (uint32_t i = 0; i < kBenchmarkWindows; i++)
+	{
+		doubleSink += referenceRmsQ8(windows[i % 64], kWarpSizesINA219WindowSamples);
+	}
+	doubleNanoseconds = nanoseconds() - start;
+
+	start = nanoseconds();
+	for (uint32_t i = 0; i < kBenchmarkWindows; i++)
+	{
+		integerSink += integerRmsQ8(windows[i % 64], kWarpSizesINA219WindowSamples);
+	}
+	integerNanoseconds = nanoseconds() - start;
+
+	printf("test-rms: %d-sample window RMS: double %.1fns, integer %.1fns\n",
+		kWarpSizesINA219WindowSamples,
+		(double)doubleNanoseconds / kBenchmarkWindows,
+		(double)integerNanoseconds / kBenchmarkWindows);
+
+	start = nanoseconds();
+	for (uint32_t i = 0; i < kBenchmarkWindows; i++)
+	{
+		integerSink += warpSquareRoot64(((uint64_t)i << 32) | i);
+	}
+	integerNanoseconds = nanoseconds() - start;
+
+	printf("test-rms: warpSquareRoot64 %.1fns\n", (double)integerNanoseconds / kBenchmarkWindows);
+}
+
+int
+main(void)
+{
+	testSquareRoot();
+	testRms();
+	testPower();
+	benchmark();
+
+	printf("test-rms: %s\n", (failures == 0) ? "passed" : "FAILED");
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "fsl_tpm_driver.h"
+#include "fsl_interrupt_manager.h"
+#include "fsl_os_abstraction.h"
+
+#include "SEGGER_RTT.h"
+#include "warp.h"
+
+
+/*
+ *	Host stand-ins for the KSDK and RTT calls the code under test makes.
+ *	Nothing here touches hardware: interrupts are never masked (the tests
+ *	are single-threaded) and the timer is not running.
+ */
+
+void
+INT_SYS_DisableIRQGlobal(void)
+{
+}
+
+void
+INT_SYS_EnableIRQGlobal(void)
+{
+}
+
+uint64_t
+OSA_TimeGetUsec(void)
+{
+	return 0;
+}
+
+uint32_t
+OSA_TimeGetMsec(void)
+{
+	return 0;
+}
+
+void
+TPM_DRV_Init(uint8_t instance, tpm_general_config_t *  info)
+{
+}
+
+void
+TPM_DRV_Deinit(uint8_t instance)
+{
+}
+
+void
+TPM_DRV_SetClock(uint8_t instance, tpm_clock_source_t clock, tpm_clock_ps_t clockPs)
+{
+}
+
+uint32_t
+TPM_DRV_GetClock(uint8_t instance)
+{
+	return 0;
+}
+
+void
+TPM_DRV_CounterStart(uint8_t instance, tpm_counting_mode_t countMode, uint32_t countFinalVal, bool enableOverflowInt)
+{
+}
+
+void
+TPM_DRV_CounterStop(uint8_t instance)
+{
+}
+
+unsigned
+SEGGER_RTT_WriteString(unsigned BufferIndex, const char *  s)
+{
+	return fputs(s, stdout);
+}
+
+int
+SEGGER_RTT_printf(unsigned BufferIndex, const char *  sFormat, ...)
+{
+	va_list		arguments;
+	int		count;
+
+	va_start(arguments, sFormat);
+	count = vprintf(sFormat, arguments);
+	va_end(arguments);
+
+	return count;
+}
+
+/*
+ *	Only the acquisition path is exercised; the queued and tuning reads
+ *	report that the device is not there.
+ */
+WarpStatus
+warpRegmapWrite(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t deviceRegister, uint16_t payload)
+{
+	return kWarpStatusDeviceCommunicationFailed;
+}
+
+WarpStatus
+warpRegmapReadAgain(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, int numberOfBytes)
+{
+	return kWarpStatusDeviceCommunicationFailed;
+}
+
+WarpStatus
+warpRegmapTuneSpeed(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t probeRegister, uint16_t readsPerSpeed)
+{
+	return kWarpStatusDeviceCommunicationFailed;
+}
+
+WarpStatus
+warpI2CQueueSubmit(WarpI2CTransaction *  transaction)
+{
+	return kWarpStatusDeviceCommunicationFailed;
+}
+
+WarpStatus
+warpI2CQueueWait(uint32_t timeoutMilliseconds)
+{
+	return kWarpStatusDeviceCommunicationFailed;
+}
+
+/*
+ *	The INA219 register map is big-endian.
+ */
+uint16_t
+warpRegmapGetValue(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t index)
+{
+	volatile uint8_t *	bytes = &deviceStatePointer->i2cBuffer[index * 2];
+
+	return (bytes[0] << 8) | bytes[1];
+}
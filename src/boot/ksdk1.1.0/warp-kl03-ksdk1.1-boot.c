@@ -39,7 +39,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
 
 #include "fsl_misc_utilities.h"
 #include "fsl_device_registers.h"
@@ -89,6 +88,10 @@
 
 #define WARP_BUILD_ENABLE_SEGGER_RTT_PRINTF
 //#define WARP_BUILD_BOOT_TO_CSVSTREAM
+//#define WARP_BUILD_ENABLE_INA219_CHANNELS
+//#define WARP_BUILD_ENABLE_I2C_BENCHMARK
+//#define WARP_BUILD_ENABLE_I2C_AUTOTUNE
+#define WARP_BUILD_ENABLE_CYCLE_SYNCHRONISED_RMS
 
 
 /*
@@ -118,6 +121,11 @@ volatile WarpI2CDeviceState			deviceMMA8451QState;
 
 #ifdef WARP_BUILD_ENABLE_DEVINA219
 volatile WarpI2CDeviceState			deviceINA219State;
+volatile WarpINA219AcquisitionState		deviceINA219AcquisitionState;
+#ifdef WARP_BUILD_ENABLE_INA219_CHANNELS
+WarpINA219Device				deviceINA219Channels[kWarpINA219DefaultChannels];
+WarpINA219Scheduler				deviceINA219Scheduler;
+#endif
 #endif
 
 #ifdef WARP_BUILD_ENABLE_DEVLPS25H
@@ -178,6 +186,64 @@ volatile WarpI2CDeviceState			deviceAS7263State;
 volatile WarpI2CDeviceState			deviceRV8803C7State;
 #endif
 
+/*
+ *	What to look for on the bus at boot, for each device built in. IDs
+ *	and alternate addresses are from the datasheets. Devices without a
+ *	usable ID register come last: they are recognised by an ACK alone.
+ */
+static const WarpI2CProbe			i2cProbes[] =
+{
+#ifdef WARP_BUILD_ENABLE_DEVBMX055
+	{kWarpSensorBMX055accel,	"BMX055accel",	&deviceBMX055accelState,	0x19,	0x00,	1,	0xFA},
+	{kWarpSensorBMX055gyro,		"BMX055gyro",	&deviceBMX055gyroState,		0x69,	0x00,	1,	0x0F},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVMMA8451Q
+	{kWarpSensorMMA8451Q,		"MMA8451Q",	&deviceMMA8451QState,		0x1C,	0x0D,	1,	0x1A},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVLPS25H
+	{kWarpSensorLPS25H,		"LPS25H",	&deviceLPS25HState,		0x5D,	0x0F,	1,	0xBD},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVHDC1000
+	{kWarpSensorHDC1000,		"HDC1000",	&deviceHDC1000State,		0x40,	0xFF,	2,	0x1000},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVMAG3110
+	{kWarpSensorMAG3110,		"MAG3110",	&deviceMAG3110State,		0,	0x07,	1,	0xC4},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVL3GD20H
+	{kWarpSensorL3GD20H,		"L3GD20H",	&deviceL3GD20HState,		0x6B,	0x0F,	1,	0xD7},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVBME680
+	{kWarpSensorBME680,		"BME680",	&deviceBME680State,		0x76,	0xD0,	1,	0x61},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVTCS34725
+	{kWarpSensorTCS34725,		"TCS34725",	&deviceTCS34725State,		0,	0x92,	1,	0x44},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVCCS811
+	{kWarpSensorCCS811,		"CCS811",	&deviceCCS811State,		0x5B,	0x20,	1,	0x81},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVBMX055
+	{kWarpSensorBMX055mag,		"BMX055mag",	&deviceBMX055magState,		0,	0,	0,	0},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVSI7021
+	{kWarpSensorSI7021,		"SI7021",	&deviceSI7021State,		0,	0,	0,	0},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVSI4705
+	{kWarpSensorSI4705,		"SI4705",	&deviceSI4705State,		0x63,	0,	0,	0},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVAMG8834
+	{kWarpSensorAMG8834,		"AMG8834",	&deviceAMG8834State,		0x69,	0,	0,	0},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVAS7262
+	{kWarpSensorAS7262,		"AS7262",	&deviceAS7262State,		0,	0,	0,	0},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVAS7263
+	{kWarpSensorAS7263,		"AS7263",	&deviceAS7263State,		0,	0,	0,	0},
+#endif
+#ifdef WARP_BUILD_ENABLE_DEVINA219
+	{kWarpSensorINA219,		"INA219",	&deviceINA219State,		0,	0,	0,	0},
+#endif
+};
+
 /*
  *	TODO: move this and possibly others into a global structure
  */
@@ -221,6 +287,10 @@ void					powerupAllSensors(void);
 uint8_t					readHexByte(void);
 int					read4digits(void);
 void					printAllSensors(bool printHeadersAndCalibration, bool hexModeFlag, int menuDelayBetweenEachRun, int i2cPullupValue);
+void					scanI2cDevices(void);
+#ifdef WARP_BUILD_ENABLE_I2C_BENCHMARK
+void					benchmarkI2cReads(void);
+#endif
 
 
 /*
@@ -266,6 +336,10 @@ clockManagerCallbackRoutine(clock_notify_struct_t *  notify, void *  callbackDat
 			break;
 		case kClockManagerNotifyRecover:
 		case kClockManagerNotifyAfter:
+			/*
+			 *	SysTick, behind the OSA microsecond time, runs off the core clock.
+			 */
+			OSA_TimeUpdateClock();
 			break;
 		default:
 			result = kClockManagerError;
@@ -437,6 +511,15 @@ enableSPIpins(void)
 
 
 
+void
+warpFastGpioInit(WarpFastGpio *  pin, uint32_t pinName)
+{
+	pin->port = (GPIO_EXTRACT_PORT(pinName) == HW_GPIOA) ? FGPIOA : FGPIOB;
+	pin->mask = 1U << GPIO_EXTRACT_PIN(pinName);
+}
+
+
+
 void
 disableSPIpins(void)
 {
@@ -485,6 +568,82 @@ enableI2Cpins(uint16_t pullupValue)
 
 
 
+/*
+ *	Fill the device registry from the bus. Needs the I2C pins enabled.
+ */
+void
+scanI2cDevices(void)
+{
+	warpI2CRegistryScan(i2cProbes, sizeof(i2cProbes) / sizeof(i2cProbes[0]));
+#ifdef WARP_BUILD_ENABLE_SEGGER_RTT_PRINTF
+	warpI2CRegistryPrint();
+#endif
+}
+
+
+
+#ifdef WARP_BUILD_ENABLE_I2C_BENCHMARK
+/*
+ *	Time reads of the INA219 bus voltage register (pointer write, repeated
+ *	start, two bytes) through the interrupt-and-semaphore blocking receive
+ *	and through the polled fast path, at each standard bus speed. The
+ *	speeds are as requested; the divider the I2C module picks may differ
+ *	slightly.
+ */
+void
+benchmarkI2cReads(void)
+{
+	static const uint16_t	speedsKbps[] = {100, 200, 400};
+	const uint16_t		readsPerSpeed = 100;
+	const uint8_t		pointerByte = kWarpINA219RegisterBusVoltage;
+	uint8_t			buffer[2];
+	uint64_t		startMicroseconds;
+	uint32_t		blockingMicroseconds;
+	uint32_t		fastMicroseconds;
+	uint16_t		failures;
+
+
+	SEGGER_RTT_WriteString(0, "\r\n\tkbps, blocking us/read, fast us/read, failures\n");
+	OSA_TimeDelay(gWarpMenuPrintDelayMilliseconds);
+
+	for (uint8_t speed = 0; speed < sizeof(speedsKbps) / sizeof(speedsKbps[0]); speed++)
+	{
+		i2c_device_t slave =
+		{
+			.address = deviceINA219State.i2cAddress,
+			.baudRate_kbps = speedsKbps[speed]
+		};
+
+		failures = 0;
+
+		startMicroseconds = OSA_TimeGetUsec();
+		for (uint16_t i = 0; i < readsPerSpeed; i++)
+		{
+			if (I2C_DRV_MasterReceiveDataBlocking(0 /* I2C peripheral instance */, &slave, &pointerByte, 1, buffer, 2, gWarpI2cTimeoutMilliseconds) != kStatus_I2C_Success)
+			{
+				failures++;
+			}
+		}
+		blockingMicroseconds = (OSA_TimeGetUsec() - startMicroseconds) / readsPerSpeed;
+
+		startMicroseconds = OSA_TimeGetUsec();
+		for (uint16_t i = 0; i < readsPerSpeed; i++)
+		{
+			if (I2C_DRV_MasterReceiveDataFast(0 /* I2C peripheral instance */, &slave, &pointerByte, 1, buffer, 2, gWarpI2cTimeoutMilliseconds) != kStatus_I2C_Success)
+			{
+				failures++;
+			}
+		}
+		fastMicroseconds = (OSA_TimeGetUsec() - startMicroseconds) / readsPerSpeed;
+
+		SEGGER_RTT_printf(0, "\t%d, %d, %d, %d\n", speedsKbps[speed], blockingMicroseconds, fastMicroseconds, failures);
+		OSA_TimeDelay(gWarpMenuPrintDelayMilliseconds);
+	}
+}
+#endif
+
+
+
 void
 disableI2Cpins(void)
 {
@@ -1354,63 +1513,265 @@ main(void)
 
 // Run display initialisation
 devSSD1331init();
+devSSD1331ConfigureGovernor(kSSD1331GovernorDefaultFramesPerSecond, kSSD1331GovernorDefaultBudgetMicroseconds);
+devSSD1331ConfigurePowerManager(kSSD1331PowerDefaultDimAfterSeconds, kSSD1331PowerDefaultBlankAfterSeconds, kSSD1331PowerDefaultWakeThresholdWatts);
 
 int readingCount = 0;
-int menuDelayBetweenEachRun = 500;
 int numberOfConfigErrors = 0;
 
 enableI2Cpins(menuI2cPullupValue);
+scanI2cDevices();
 
+/*
+ *	Nothing to meter without the INA219.
+ */
+if (!warpI2CRegistryIsPresent(kWarpSensorINA219))
+{
+	SEGGER_RTT_WriteString(0, "No INA219 on the bus\n");
+	sleepUntilReset();
+}
 
-numberOfConfigErrors += configureSensorINA219(0b0011100110011111,/* Put in to default mode */
-												menuI2cPullupValue
-												);
 
+/*
+ *	The acquisition engine only reads the shunt voltage, so don't spend
+ *	conversion time on the bus voltage. No on-chip averaging: it would
+ *	low-pass the current waveform the RMS is computed over.
+ */
+WarpINA219Profile	waveformProfile =
+{
+	.busRange	= kWarpINA219BusRange32V,
+	.gain		= kWarpINA219Gain8Range320mV,
+	.busAdc		= kWarpINA219Adc12Bit,
+	.shuntAdc	= kWarpINA219Adc12Bit,
+	.mode		= kWarpINA219ModeShuntContinuous,
+	.calibration	= 0x5000,
+};
+
+numberOfConfigErrors += configureProfileINA219(&waveformProfile, menuI2cPullupValue);
+
+#ifdef WARP_BUILD_ENABLE_I2C_BENCHMARK
+benchmarkI2cReads();
+#endif
+
+#ifdef WARP_BUILD_ENABLE_I2C_AUTOTUNE
+tuneI2cSpeedINA219(menuI2cPullupValue);
+SEGGER_RTT_printf(0, "INA219 I2C speed: %ukHz\n", deviceINA219State.speed.baudRateKbps);
+#endif
+
+
+	/*
+	 *	Pick up the energy total from the last flash checkpoint.
+	 */
+	WarpEnergyIntegrator	energy;
+	uint32_t		lastElapsedPeriods = 0;
+
+	warpEnergyRestore(&energy);
+	SEGGER_RTT_printf(0, "Energy restored: %umWh, boot %u\n", warpEnergyGetMilliwattHours(&energy), energy.bootCount);
+
+	/*
+	 *	Sample the shunt voltage every 1ms from TPM0 (or as fast as the bus
+	 *	allows: about 1.4ms at 200kHz); each 50-sample window is processed
+	 *	and drawn below while the next one fills.
+	 */
+	startAcquisitionINA219(1000 /* samplePeriodMicroseconds */);
+	SEGGER_RTT_printf(0, "Sample period: %uus\n", deviceINA219AcquisitionState.samplePeriodMicroseconds);
+
+	/*
+	 *	Catch inrush and spikes between the windows the loop below reports on.
+	 */
+	armTransientCaptureINA219(24000 /* levelThreshold: 75% of the 320mV range */,
+				4000 /* slopeThreshold */,
+				kWarpINA219TransientDefaultPreTrigger,
+				kWarpINA219TransientDefaultPostTrigger);
+
+	/*
+	 *	Window statistics are merged into a longer reporting period so that
+	 *	slow drift is visible alongside the per-window figures.
+	 */
+	WarpStatisticsAccumulator	periodStatistics;
+	uint32_t			periodWindows = 0;
+
+	warpStatisticsReset(&periodStatistics);
+
+	/*
+	 *	In cycle-synchronised mode the displayed power comes from whole
+	 *	mains cycles rather than from each fixed-length window. Undefine
+	 *	WARP_BUILD_ENABLE_CYCLE_SYNCHRONISED_RMS for plain per-window RMS
+	 *	(e.g., for DC loads, where there are no cycles to lock to).
+	 */
+#ifdef WARP_BUILD_ENABLE_CYCLE_SYNCHRONISED_RMS
+	WarpPowerMeterMode		meterMode = kWarpPowerMeterModeCycleSynchronised;
+#else
+	WarpPowerMeterMode		meterMode = kWarpPowerMeterModeWindow;
+#endif
+	WarpCycleRmsAccumulator		cycleRms;
+	WarpHarmonicAnalyser		harmonics;
+	uint32_t			harmonicsReported = 0;
+
+	warpCycleRmsReset(&cycleRms);
+	memset(&harmonics, 0, sizeof(harmonics));
 
 	while (1)
 	{
-			
-	    #ifdef WARP_BUILD_ENABLE_SEGGER_RTT_PRINTF
-	    SEGGER_RTT_printf(0, "%u,", readingCount);
-	    #endif
-
-	    // Create a pointer to the memory where the samples are stored
-	    int num_samples = 50;
-	    int repeatedValuesINA219data[num_samples];
-
-	    // Pass the pointer to the function so it can write the samples to it
-	    repeatedReadSensorDataINA219(repeatedValuesINA219data, num_samples); 
-
-	    // A double is used to increase precision when computing the square root    
-	    double currentSumOfSquares = 0;
-
-	    for (int i = 0; i < num_samples; i++ ) 
-	    {
-		//Compute Sum of squares of current samples
-	    	currentSumOfSquares += repeatedValuesINA219data[i] * (repeatedValuesINA219data[i]/num_samples);        
-	    }
-
-	    double rmsPowerDouble;
-	    int rmsPowerInt;
-
-	    // Find power usage from RMS current and then cast it to an integer
-	    rmsPowerDouble = sqrt(currentSumOfSquares) * 0.125;
-	    rmsPowerInt = (int)rmsPowerDouble;
-
-	    // Write the power to the console for debugging
-	    SEGGER_RTT_printf(0, "Power Usage: %dW,\n", rmsPowerInt);
-
-	    // Update the display with the current power usage
-	    drawNumbersPower(rmsPowerInt);
-	    
-	    // Delay for 500ms
-	    if (menuDelayBetweenEachRun > 0)
-	    {
-		OSA_TimeDelay(menuDelayBetweenEachRun);
-	    }
-
-	    readingCount++;
-	    	
+		WarpStatisticsAccumulator	windowStatistics;
+		int32_t				rmsPowerInt;
+		uint32_t			elapsedPeriods;
+
+		while (!getReadyStatisticsINA219(&windowStatistics))
+		{
+		}
+
+		/*
+		 *	Sample periods since the last window processed, including any
+		 *	dropped windows, skipped (not ready) periods, periods missed with
+		 *	interrupts masked and discarded partial windows, so the energy
+		 *	integral covers all elapsed time.
+		 */
+		elapsedPeriods = (deviceINA219AcquisitionState.windowsCompleted + deviceINA219AcquisitionState.windowsDropped) * kWarpSizesINA219WindowSamples
+				+ deviceINA219AcquisitionState.conversionsNotReady
+				+ deviceINA219AcquisitionState.periodsMissed
+				+ deviceINA219AcquisitionState.samplesDiscarded;
+
+		if (meterMode == kWarpPowerMeterModeCycleSynchronised)
+		{
+			volatile int16_t *	window = getReadyWindowINA219();
+
+			/*
+			 *	Periods were lost before this window, so the cycle in
+			 *	progress and the harmonic block would span the gap: start
+			 *	both again.
+			 */
+			if (!getReadyWindowContiguousINA219())
+			{
+				warpCycleRmsRestart(&cycleRms);
+				warpHarmonicsTune(&harmonics, 0 /* periodQ8: none yet */);
+			}
+
+			for (int i = 0; i < kWarpSizesINA219WindowSamples; i++)
+			{
+				/*
+				 *	Harmonic analysis runs over the same whole-cycle blocks
+				 *	as the cycle RMS, tuned to the period just measured.
+				 */
+				if (warpCycleRmsAddSample(&cycleRms, window[i]))
+				{
+					warpHarmonicsFinish(&harmonics);
+					warpHarmonicsTune(&harmonics, cycleRms.resultLocked ? cycleRms.periodQ8 : 0);
+				}
+
+				if (harmonics.tuned)
+				{
+					warpHarmonicsAddSample(&harmonics, window[i]);
+				}
+			}
+		}
+
+		/*
+		 *	The statistics were accumulated by the ISR as the window filled, so
+		 *	once any cycle tracking is done the window can go straight back to
+		 *	the acquisition engine.
+		 */
+		releaseWindowINA219();
+
+		#ifdef WARP_BUILD_ENABLE_SEGGER_RTT_PRINTF
+		SEGGER_RTT_printf(0, "%u,", readingCount);
+		#endif
+
+		// Find power usage from RMS current
+		if ((meterMode == kWarpPowerMeterModeCycleSynchronised) && (cycleRms.resultCount > 0))
+		{
+			rmsPowerInt = warpPowerFromRmsQ8(cycleRms.rmsQ8, kWarpPowerScaleQ16Display);
+			SEGGER_RTT_printf(0, "Cycle RMS: %s, %u.%02u Hz\n",
+						cycleRms.resultLocked ? "locked" : "unlocked",
+						warpCycleRmsGetFrequencyCentihertz(&cycleRms, deviceINA219AcquisitionState.samplePeriodMicroseconds) / 100,
+						warpCycleRmsGetFrequencyCentihertz(&cycleRms, deviceINA219AcquisitionState.samplePeriodMicroseconds) % 100);
+		}
+		else
+		{
+			rmsPowerInt = warpPowerFromRmsQ8(warpStatisticsGetRmsQ8(&windowStatistics), kWarpPowerScaleQ16Display);
+		}
+
+		if (harmonics.resultCount != harmonicsReported)
+		{
+			harmonicsReported = harmonics.resultCount;
+
+			/*
+			 *	Peak amplitudes in register LSBs; THD in tenths of a percent.
+			 */
+			SEGGER_RTT_printf(0, "Harmonics: 1st %u, 3rd %u, 5th %u, 7th %u, 9th %u, THD %u.%u%%\n",
+						harmonics.amplitudeQ8[0] >> 8,
+						harmonics.amplitudeQ8[1] >> 8,
+						harmonics.amplitudeQ8[2] >> 8,
+						harmonics.amplitudeQ8[3] >> 8,
+						harmonics.amplitudeQ8[4] >> 8,
+						harmonics.thdPerMille / 10,
+						harmonics.thdPerMille % 10);
+		}
+
+		warpEnergyAdd(&energy,
+				warpPowerMilliwattsFromRmsQ8(warpStatisticsGetRmsQ8(&windowStatistics), kWarpPowerScaleQ16Display),
+				(elapsedPeriods - lastElapsedPeriods) * deviceINA219AcquisitionState.samplePeriodMicroseconds);
+		lastElapsedPeriods = elapsedPeriods;
+
+		/*
+		 *	Usually a no-op; a flash write happens every kWarpEnergyCheckpointSeconds.
+		 */
+		warpEnergyCheckpointIfDue(&energy, RTC_HAL_GetSecsReg(RTC_BASE));
+
+		// Write the power to the console for debugging
+		SEGGER_RTT_printf(0, "Energy: %umWh\n", warpEnergyGetMilliwattHours(&energy));
+		SEGGER_RTT_printf(0, "Power Usage: %dW, windows %u/%u dropped, %u failed, %u failed reads, %u not ready, %u missed, jitter %u ticks\n",
+					rmsPowerInt,
+					deviceINA219AcquisitionState.windowsDropped,
+					deviceINA219AcquisitionState.windowsCompleted,
+					deviceINA219AcquisitionState.windowsFailed,
+					deviceINA219AcquisitionState.readsFailed,
+					deviceINA219AcquisitionState.conversionsNotReady,
+					deviceINA219AcquisitionState.periodsMissed,
+					deviceINA219AcquisitionState.maxLatencyTicks);
+
+		/*
+		 *	Mean, variance and crest factor are in Q8 (divide by 256).
+		 */
+		SEGGER_RTT_printf(0, "\tmean %d, variance %u, min %d, max %d, p-p %u, crest %u\n",
+					warpStatisticsGetMeanQ8(&windowStatistics),
+					(uint32_t)warpStatisticsGetVarianceQ8(&windowStatistics),
+					windowStatistics.minimum,
+					windowStatistics.maximum,
+					warpStatisticsGetPeakToPeak(&windowStatistics),
+					warpStatisticsGetCrestFactorQ8(&windowStatistics));
+
+		warpStatisticsMerge(&periodStatistics, &windowStatistics);
+		if (++periodWindows == kWarpStatisticsWindowsPerPeriod)
+		{
+			SEGGER_RTT_printf(0, "Period: %dW over %u samples, mean %d, min %d, max %d, crest %u\n",
+						warpPowerFromRmsQ8(warpStatisticsGetRmsQ8(&periodStatistics), kWarpPowerScaleQ16Display),
+						periodStatistics.sampleCount,
+						warpStatisticsGetMeanQ8(&periodStatistics),
+						periodStatistics.minimum,
+						periodStatistics.maximum,
+						warpStatisticsGetCrestFactorQ8(&periodStatistics));
+			warpI2CPrintHealth("INA219", &deviceINA219State);
+
+			warpStatisticsReset(&periodStatistics);
+			periodWindows = 0;
+		}
+
+		printTransientCaptureINA219();
+
+		// Update the display with the current power usage, at most at the governor's frame rate
+		if (devSSD1331SubmitPower(rmsPowerInt))
+		{
+			SEGGER_RTT_printf(0, "Display: %u SPI bytes, %uus busy, %u frames, %u values merged, %u skipped\n",
+						devSSD1331GetFrameBytes(),
+						devSSD1331GetFrameBusyMicroseconds(),
+						devSSD1331GetGovernor()->framesRendered,
+						devSSD1331GetGovernor()->valuesSubmitted - devSSD1331GetGovernor()->framesRendered,
+						devSSD1331GetGovernor()->framesSkipped);
+		}
+		devSSD1331PushHistory(rmsPowerInt);
+
+		readingCount++;
 	}
 
 	return 0;
@@ -1428,44 +1789,107 @@ printAllSensors(bool printHeadersAndCalibration, bool hexModeFlag, int menuDelay
 	uint32_t	numberOfConfigErrors = 0;
 
 
+	/*
+	 *	The switched sensor supply is on by now, so this sees the sensors
+	 *	powered from it as well.
+	 */
+	scanI2cDevices();
+
 	#ifdef WARP_BUILD_ENABLE_DEVAMG8834
-	numberOfConfigErrors += configureSensorAMG8834(	0x3F,/* Initial reset */
-					0x01,/* Frame rate 1 FPS */
-					i2cPullupValue
-					);
+	if (warpI2CRegistryIsPresent(kWarpSensorAMG8834))
+	{
+		numberOfConfigErrors += configureSensorAMG8834(	0x3F,/* Initial reset */
+						0x01,/* Frame rate 1 FPS */
+						i2cPullupValue
+						);
+	}
 	#endif
 	#ifdef WARP_BUILD_ENABLE_DEVMMA8451Q
-	numberOfConfigErrors += configureSensorMMA8451Q(0x00,/* Payload: Disable FIFO */
-					0x01,/* Normal read 8bit, 800Hz, normal, active mode */
-					i2cPullupValue
-					);
+	if (warpI2CRegistryIsPresent(kWarpSensorMMA8451Q))
+	{
+		numberOfConfigErrors += configureSensorMMA8451Q(0x00,/* Payload: Disable FIFO */
+						0x01,/* Normal read 8bit, 800Hz, normal, active mode */
+						i2cPullupValue
+						);
+	}
 	#endif
 	#ifdef WARP_BUILD_ENABLE_DEVINA219
-	numberOfConfigErrors += configureSensorINA219(0b0011100110011111,/* Put in to default mode */
-					i2cPullupValue
-					);
+	if (warpI2CRegistryIsPresent(kWarpSensorINA219))
+	{
+		numberOfConfigErrors += configureSensorINA219(0b0011100110011111,/* Payload: 32V, 320mV, 12-bit, shunt and bus continuous */
+						0x5000,/* Payload: calibration */
+						i2cPullupValue
+						);
+	}
+	#ifdef WARP_BUILD_ENABLE_INA219_CHANNELS
+	WarpINA219Profile	channelProfile =
+	{
+		.busRange	= kWarpINA219BusRange32V,
+		.gain		= kWarpINA219Gain8Range320mV,
+		.busAdc		= kWarpINA219Adc12Bit,
+		.shuntAdc	= kWarpINA219Adc12Bit,
+		.mode		= kWarpINA219ModeShuntAndBusContinuous,
+		.calibration	= 0x5000,
+	};
+
+	/*
+	 *	Schedule the first kWarpINA219DefaultChannels INA219s that answer
+	 *	anywhere in 0x40-0x4F, so the scheduler never visits an empty
+	 *	address. All channels convert continuously and in parallel; the
+	 *	scheduler collects whichever is next in turn.
+	 */
+	uint8_t		channelCount = 0;
+
+	for (uint8_t i = 0; (i < kWarpINA219MaxChannels) && (channelCount < kWarpINA219DefaultChannels); i++)
+	{
+		WarpINA219Device *	candidate = &deviceINA219Channels[channelCount];
+		WarpI2CProbe		probe =
+		{
+			.sensor			= kWarpSensorINA219,
+			.name			= "INA219",
+			.deviceStatePointer	= &candidate->i2c,
+		};
+
+		initDeviceINA219(candidate, kWarpINA219BaseAddress + i);
+		if (warpI2CRegistryProbe(&probe))
+		{
+			numberOfConfigErrors += configureProfileDeviceINA219(candidate, &channelProfile);
+			channelCount++;
+		}
+	}
+	initSchedulerINA219(&deviceINA219Scheduler, deviceINA219Channels, channelCount);
+	#endif
 	#endif
 	#ifdef WARP_BUILD_ENABLE_DEVMAG3110
-	numberOfConfigErrors += configureSensorMAG3110(	0x00,/*	Payload: DR 000, OS 00, 80Hz, ADC 1280, Full 16bit, standby mode to set up register*/
-					0xA0,/*	Payload: AUTO_MRST_EN enable, RAW value without offset */
-					i2cPullupValue
-					);
+	if (warpI2CRegistryIsPresent(kWarpSensorMAG3110))
+	{
+		numberOfConfigErrors += configureSensorMAG3110(	0x00,/*	Payload: DR 000, OS 00, 80Hz, ADC 1280, Full 16bit, standby mode to set up register*/
+						0xA0,/*	Payload: AUTO_MRST_EN enable, RAW value without offset */
+						i2cPullupValue
+						);
+	}
 	#endif
 	#ifdef WARP_BUILD_ENABLE_DEVL3GD20H
-	numberOfConfigErrors += configureSensorL3GD20H(	0b11111111,/* ODR 800Hz, Cut-off 100Hz, see table 21, normal mode, x,y,z enable */
-					0b00100000,
-					0b00000000,/* normal mode, disable FIFO, disable high pass filter */
-					i2cPullupValue
-					);
+	if (warpI2CRegistryIsPresent(kWarpSensorL3GD20H))
+	{
+		numberOfConfigErrors += configureSensorL3GD20H(	0b11111111,/* ODR 800Hz, Cut-off 100Hz, see table 21, normal mode, x,y,z enable */
+						0b00100000,
+						0b00000000,/* normal mode, disable FIFO, disable high pass filter */
+						i2cPullupValue
+						);
+	}
 	#endif
 	#ifdef WARP_BUILD_ENABLE_DEVBME680
-	numberOfConfigErrors += configureSensorBME680(	0b00000001,	/*	Humidity oversampling (OSRS) to 1x				*/
-							0b00100100,	/*	Temperature oversample 1x, pressure overdsample 1x, mode 00	*/
-							0b00001000,	/*	Turn off heater							*/
-							i2cPullupValue
-					);
+	if (warpI2CRegistryIsPresent(kWarpSensorBME680))
+	{
+		numberOfConfigErrors += configureSensorBME680(	0b00000001,	/*	Humidity oversampling (OSRS) to 1x				*/
+								0b00100100,	/*	Temperature oversample 1x, pressure overdsample 1x, mode 00	*/
+								0b00001000,	/*	Turn off heater							*/
+								i2cPullupValue
+						);
+	}
 
-	if (printHeadersAndCalibration)
+	if (printHeadersAndCalibration && warpI2CRegistryIsPresent(kWarpSensorBME680))
 	{
 		SEGGER_RTT_WriteString(0, "\r\n\nBME680 Calibration Data: ");
 		for (uint8_t i = 0; i < kWarpSizesBME680CalibrationValuesCount; i++)
@@ -1488,34 +1912,49 @@ printAllSensors(bool printHeadersAndCalibration, bool hexModeFlag, int menuDelay
 	#endif
 
 	#ifdef WARP_BUILD_ENABLE_DEVHDC1000
-	numberOfConfigErrors += writeSensorRegisterHDC1000(kWarpSensorConfigurationRegisterHDC1000Configuration,/* Configuration register	*/
-					(0b1010000<<8),
-					i2cPullupValue
-					);
+	if (warpI2CRegistryIsPresent(kWarpSensorHDC1000))
+	{
+		numberOfConfigErrors += writeSensorRegisterHDC1000(kWarpSensorConfigurationRegisterHDC1000Configuration,/* Configuration register	*/
+						(0b1010000<<8),
+						i2cPullupValue
+						);
+	}
 	#endif
 
 	#ifdef WARP_BUILD_ENABLE_DEVCCS811
-	uint8_t		payloadCCS811[1];
-	payloadCCS811[0] = 0b01000000;/* Constant power, measurement every 250ms */
-	numberOfConfigErrors += configureSensorCCS811(payloadCCS811,
-					i2cPullupValue
-					);
+	if (warpI2CRegistryIsPresent(kWarpSensorCCS811))
+	{
+		uint8_t		payloadCCS811[1];
+		payloadCCS811[0] = 0b01000000;/* Constant power, measurement every 250ms */
+		numberOfConfigErrors += configureSensorCCS811(payloadCCS811,
+						i2cPullupValue
+						);
+	}
 	#endif
 	#ifdef WARP_BUILD_ENABLE_DEVBMX055
-	numberOfConfigErrors += configureSensorBMX055accel(0b00000011,/* Payload:+-2g range */
-					0b10000000,/* Payload:unfiltered data, shadowing enabled */
-					i2cPullupValue
-					);
-	numberOfConfigErrors += configureSensorBMX055mag(0b00000001,/* Payload:from suspend mode to sleep mode*/
-					0b00000001,/* Default 10Hz data rate, forced mode*/
-					i2cPullupValue
-					);
-	numberOfConfigErrors += configureSensorBMX055gyro(0b00000100,/* +- 125degrees/s */
-					0b00000000,/* ODR 2000 Hz, unfiltered */
-					0b00000000,/* normal mode */
-					0b10000000,/* unfiltered data, shadowing enabled */
-					i2cPullupValue
-					);
+	if (warpI2CRegistryIsPresent(kWarpSensorBMX055accel))
+	{
+		numberOfConfigErrors += configureSensorBMX055accel(0b00000011,/* Payload:+-2g range */
+						0b10000000,/* Payload:unfiltered data, shadowing enabled */
+						i2cPullupValue
+						);
+	}
+	if (warpI2CRegistryIsPresent(kWarpSensorBMX055mag))
+	{
+		numberOfConfigErrors += configureSensorBMX055mag(0b00000001,/* Payload:from suspend mode to sleep mode*/
+						0b00000001,/* Default 10Hz data rate, forced mode*/
+						i2cPullupValue
+						);
+	}
+	if (warpI2CRegistryIsPresent(kWarpSensorBMX055gyro))
+	{
+		numberOfConfigErrors += configureSensorBMX055gyro(0b00000100,/* +- 125degrees/s */
+						0b00000000,/* ODR 2000 Hz, unfiltered */
+						0b00000000,/* normal mode */
+						0b10000000,/* unfiltered data, shadowing enabled */
+						i2cPullupValue
+						);
+	}
 	#endif
 
 
@@ -1527,7 +1966,11 @@ printAllSensors(bool printHeadersAndCalibration, bool hexModeFlag, int menuDelay
 		
 
 		#ifdef WARP_BUILD_ENABLE_DEVINA219
-		SEGGER_RTT_WriteString(0, " Shunt V, Bus V, Current,");
+		#ifdef WARP_BUILD_ENABLE_INA219_CHANNELS
+		SEGGER_RTT_WriteString(0, " Channel, Shunt V, Bus V, Current, Power, us Since Last, Not Ready, Failed,");
+		#else
+		SEGGER_RTT_WriteString(0, " Shunt V, Bus V, Current, Power, I2C Transactions, Snapshot us,");
+		#endif
 		OSA_TimeDelay(gWarpMenuPrintDelayMilliseconds);
 		#endif
 		
@@ -1542,46 +1985,67 @@ printAllSensors(bool printHeadersAndCalibration, bool hexModeFlag, int menuDelay
 		SEGGER_RTT_printf(0, "%u,", readingCount);
 		#endif
 
-		#ifdef WARP_BUILD_ENABLE_DEVINA219
+		#if defined(WARP_BUILD_ENABLE_DEVINA219) && defined(WARP_BUILD_ENABLE_INA219_CHANNELS)
+		uint8_t		channel = kWarpINA219MaxChannels;
+
+		/*
+		 *	Bounded, so that a missing channel can't stall the stream.
+		 */
+		for (uint32_t visits = 0; (visits < kWarpINA219ConversionMaxPolls) && (channel == kWarpINA219MaxChannels); visits++)
+		{
+			channel = serviceSchedulerINA219(&deviceINA219Scheduler);
+		}
+
+		if (channel == kWarpINA219MaxChannels)
+		{
+			SEGGER_RTT_WriteString(0, " -, -, -, -, -, -, -, -,\n");
+		}
+		else
+		{
+			WarpINA219Device *	device = &deviceINA219Channels[channel];
+			SEGGER_RTT_printf(0, " 0x%02x, %d, %u, %d, %u, %u, %u, %u,\n",
+						device->i2c.i2cAddress,
+						device->snapshot.shuntVoltage,
+						device->snapshot.busVoltage,
+						device->snapshot.current,
+						device->snapshot.power,
+						device->snapshot.elapsedMicroseconds,
+						device->notReadyCount,
+						device->failedCount);
+		}
+		#elif defined(WARP_BUILD_ENABLE_DEVINA219)
 		//printSensorDataINA219(hexModeFlag);
-		int num_samples = 40;
-		int repeatedValuesINA219data[num_samples];
+		if (!warpI2CRegistryIsPresent(kWarpSensorINA219))
+		{
+			SEGGER_RTT_WriteString(0, " -,\n");
+		}
+		else
+		{
+			int num_samples = 40;
+			int repeatedValuesINA219data[num_samples];
 
-		repeatedReadSensorDataINA219(repeatedValuesINA219data, num_samples); 
+			repeatedReadSensorDataINA219(repeatedValuesINA219data, num_samples); 
 		
-		int maxBatchValue = 0;
-		double currentSumOfSquares = 0;
+			WarpStatisticsAccumulator	batchStatistics;
+			int32_t				rmsPowerInt;
 
-		for (int i = 0; i < num_samples; i++ ) 
-		{
-			/*			
-			//SEGGER_RTT_printf(0, "%d, %d, %d,\n", readingCount, i, repeatedValuesINA219data[i]);
-			if (abs(repeatedValuesINA219data[i]) > maxBatchValue)
+			warpStatisticsReset(&batchStatistics);
+			for (int i = 0; i < num_samples; i++ ) 
 			{
-				// New larger batch value found so update max value
-				maxBatchValue = abs(repeatedValuesINA219data[i]);
+				warpStatisticsAddSample(&batchStatistics, repeatedValuesINA219data[i]);
 			}
-			*/
-			
-			// Compute RMS of current draw to caclulate power
-			currentSumOfSquares += repeatedValuesINA219data[i] * (repeatedValuesINA219data[i]/num_samples);
-			
-   		}
-
-		//float maxPowerFloat;
-		//int maxPowerInt;
-
-		//maxPowerFloat = maxBatchValue * 0.09;
-		//maxPowerInt = (int)maxPowerFloat;
-		//SEGGER_RTT_printf(0, "Power Usage: %dW,\n", maxPowerInt);
 
-		double rmsPowerDouble;
-		int rmsPowerInt;
-		rmsPowerDouble = sqrt(currentSumOfSquares) * 0.12;
-		rmsPowerInt = (int)rmsPowerDouble;
-		SEGGER_RTT_printf(0, "Power Usage: %dW,\n", rmsPowerInt);
+			/*
+			 *	Power from the RMS current, with the batch peak alongside it.
+			 */
+			rmsPowerInt = warpPowerFromRmsQ8(warpStatisticsGetRmsQ8(&batchStatistics), kWarpPowerScaleQ16CsvStream);
+			SEGGER_RTT_printf(0, "Power Usage: %dW, peak %u, crest %u,\n",
+						rmsPowerInt,
+						warpStatisticsGetPeak(&batchStatistics),
+						warpStatisticsGetCrestFactorQ8(&batchStatistics));
 
-		drawNumbersPower(rmsPowerInt);
+			drawNumbersPower(rmsPowerInt);
+		}
 		
 
 
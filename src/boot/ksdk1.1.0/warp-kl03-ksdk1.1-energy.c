@@ -0,0 +1,215 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "fsl_interrupt_manager.h"
+#include "SSD_FTFx.h"
+
+#include "warp.h"
+
+
+/*
+ *	Energy integration and flash checkpointing.
+ *
+ *	Each processed window adds power x duration to a 64-bit total. Every
+ *	kWarpEnergyCheckpointSeconds the total is appended as a record to one
+ *	of two flash sectors. When a sector fills, the other one is erased and
+ *	written next, so the newest record always survives an interrupted erase
+ *	and each sector is erased once per pass rather than once per checkpoint.
+ *	At boot, the valid record with the highest sequence number wins.
+ */
+
+
+
+static FLASH_SSD_CONFIG	flashConfiguration =
+{
+	.ftfxRegBase	= FTFA_BASE,
+	.PFlashBase	= 0,
+	.PFlashSize	= FSL_FEATURE_FLASH_PFLASH_BLOCK_SIZE,
+	.DFlashBase	= 0,
+	.DFlashSize	= 0,
+	.EERAMBase	= 0,
+	.EEESize	= 0,
+	.DebugEnable	= false,
+	.CallBack	= NULL_CALLBACK,
+};
+
+static uint16_t
+recordsPerSector(void)
+{
+	return kWarpEnergyFlashSectorBytes / sizeof(WarpEnergyRecord);
+}
+
+static uint16_t
+recordCount(void)
+{
+	return recordsPerSector() * kWarpEnergyFlashSectorCount;
+}
+
+static uint32_t
+recordAddress(uint16_t index)
+{
+	return kWarpEnergyFlashBase + (index / recordsPerSector()) * kWarpEnergyFlashSectorBytes
+					+ (index % recordsPerSector()) * sizeof(WarpEnergyRecord);
+}
+
+static uint32_t
+recordChecksum(const WarpEnergyRecord *  record)
+{
+	return	0x5A5A5A5A ^ record->sequence ^ record->bootCount ^ record->rtcSeconds ^
+		(uint32_t)record->microjoules ^ (uint32_t)(record->microjoules >> 32);
+}
+
+static bool
+recordIsValid(const WarpEnergyRecord *  record)
+{
+	return (record->sequence != 0xFFFFFFFF) && (record->checksum == recordChecksum(record));
+}
+
+static bool
+recordIsBlank(uint16_t index)
+{
+	const uint32_t *	word = (const uint32_t *)recordAddress(index);
+
+	for (uint8_t i = 0; i < sizeof(WarpEnergyRecord) / sizeof(uint32_t); i++)
+	{
+		if (word[i] != 0xFFFFFFFF)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+WarpStatus
+warpEnergyRestore(WarpEnergyIntegrator *  energy)
+{
+	const WarpEnergyRecord *	newest = NULL;
+	uint16_t			newestIndex = 0;
+
+
+	memset(energy, 0, sizeof(WarpEnergyIntegrator));
+
+	if (FlashInit(&flashConfiguration) != FTFx_OK)
+	{
+		energy->lastFlashStatus = kWarpStatusDeviceNotInitialized;
+
+		return energy->lastFlashStatus;
+	}
+
+	for (uint16_t index = 0; index < recordCount(); index++)
+	{
+		const WarpEnergyRecord *	record = (const WarpEnergyRecord *)recordAddress(index);
+
+		if (recordIsValid(record) && ((newest == NULL) || (record->sequence > newest->sequence)))
+		{
+			newest = record;
+			newestIndex = index;
+		}
+	}
+
+	if (newest != NULL)
+	{
+		energy->microjoules	= newest->microjoules;
+		energy->sequence	= newest->sequence + 1;
+		energy->bootCount	= newest->bootCount + 1;
+		energy->nextRecord	= (newestIndex + 1) % recordCount();
+	}
+
+	return kWarpStatusOK;
+}
+
+void
+warpEnergyAdd(WarpEnergyIntegrator *  energy, uint32_t powerMilliwatts, uint32_t durationMicroseconds)
+{
+	/*
+	 *	mW x us is nJ. The 64-bit division costs tens of microseconds, once
+	 *	per window.
+	 */
+	uint64_t	nanojoules = (uint64_t)powerMilliwatts * durationMicroseconds + energy->remainderNanojoules;
+
+	energy->microjoules		+= nanojoules / 1000;
+	energy->remainderNanojoules	= nanojoules % 1000;
+}
+
+uint32_t
+warpEnergyGetMilliwattHours(const WarpEnergyIntegrator *  energy)
+{
+	return (uint32_t)(energy->microjoules / 3600000);
+}
+
+/*
+ *	Run a C90TFS erase or program with interrupts disabled: vectors and
+ *	handlers live in the flash block being modified. An erase takes
+ *	several INA219 sample periods; the acquisition ISR counts them as
+ *	missed (periodsMissed) when it next runs.
+ */
+static WarpStatus
+writeRecord(uint16_t index, const WarpEnergyRecord *  record)
+{
+	uint16_t		launchCommand[kWarpEnergyFlashLaunchCommandBytes / sizeof(uint16_t)];
+	pFLASHCOMMANDSEQUENCE	launchCommandInRam;
+	uint32_t		address = recordAddress(index);
+	uint32_t		status = FTFx_OK;
+
+
+	launchCommandInRam = (pFLASHCOMMANDSEQUENCE)RelocateFunction((uint32_t)launchCommand,
+								kWarpEnergyFlashLaunchCommandBytes,
+								(uint32_t)FlashCommandSequence);
+
+	INT_SYS_DisableIRQGlobal();
+
+	if ((index % recordsPerSector()) == 0)
+	{
+		status = FlashEraseSector(&flashConfiguration, address, kWarpEnergyFlashSectorBytes, launchCommandInRam);
+	}
+
+	if (status == FTFx_OK)
+	{
+		status = FlashProgram(&flashConfiguration, address, sizeof(WarpEnergyRecord), (uint8_t *)record, launchCommandInRam);
+	}
+
+	INT_SYS_EnableIRQGlobal();
+
+	return (status == FTFx_OK) ? kWarpStatusOK : kWarpStatusCommsError;
+}
+
+WarpStatus
+warpEnergyCheckpointIfDue(WarpEnergyIntegrator *  energy, uint32_t rtcSeconds)
+{
+	WarpEnergyRecord	record;
+
+
+	if ((rtcSeconds - energy->lastCheckpointSeconds) < kWarpEnergyCheckpointSeconds)
+	{
+		return kWarpStatusOK;
+	}
+
+	energy->lastCheckpointSeconds = rtcSeconds;
+
+	/*
+	 *	A slot that is neither blank nor the start of a sector (e.g., from a
+	 *	write cut short by a reset, or left over from a previous image) can't
+	 *	be programmed. Move on to the other sector, which gets erased first.
+	 */
+	if (!recordIsBlank(energy->nextRecord) && ((energy->nextRecord % recordsPerSector()) != 0))
+	{
+		energy->nextRecord = ((energy->nextRecord / recordsPerSector() + 1) % kWarpEnergyFlashSectorCount) * recordsPerSector();
+	}
+
+	record.sequence		= energy->sequence;
+	record.bootCount	= energy->bootCount;
+	record.rtcSeconds	= rtcSeconds;
+	record.microjoules	= energy->microjoules;
+	record.checksum		= recordChecksum(&record);
+
+	energy->lastFlashStatus = writeRecord(energy->nextRecord, &record);
+	if (energy->lastFlashStatus == kWarpStatusOK)
+	{
+		energy->sequence++;
+		energy->nextRecord = (energy->nextRecord + 1) % recordCount();
+	}
+
+	return energy->lastFlashStatus;
+}
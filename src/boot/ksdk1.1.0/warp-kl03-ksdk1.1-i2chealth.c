@@ -0,0 +1,226 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fsl_i2c_master_driver.h"
+#include "fsl_i2c_shared_function.h"
+#include "fsl_port_hal.h"
+#include "fsl_gpio_hal.h"
+#include "fsl_os_abstraction.h"
+
+#include "SEGGER_RTT.h"
+#include "warp.h"
+
+
+/*
+ *	I2C bus health: retries, bus recovery and per-device counters.
+ *
+ *	The register-map routines report the outcome of every transfer attempt
+ *	to warpI2CRetryAfter(), which counts it against the device and decides
+ *	whether to go again. Between attempts it backs off, doubling the delay
+ *	each time. If the failure looks like the bus rather than the device
+ *	(a timeout, lost arbitration or a STOP that never completed), the bus
+ *	is recovered first: a slave that was cut off mid-byte can hold SDA low
+ *	indefinitely, and only clocking SCL until it lets go clears that.
+ *
+ *	Retries and recovery only happen in thread mode. In an interrupt (the
+ *	INA219 acquisition ISR) a failed transfer is counted and returned at
+ *	once: the sample spacing matters more than the sample, and the ISR may
+ *	have interrupted a thread-mode transfer that still owns the bus.
+ */
+
+enum
+{
+	kWarpI2CSclPin	= 3,	/*	PTB3	*/
+	kWarpI2CSdaPin	= 4,	/*	PTB4	*/
+};
+
+static WarpI2CRetryPolicy	retryPolicy =
+{
+	.maxRetries		= kWarpI2CRetryDefaultMaxRetries,
+	.backoffMicroseconds	= kWarpI2CRetryDefaultBackoffMicroseconds,
+};
+static WarpI2CBusHealth		busHealth;
+
+
+
+/*
+ *	Open-drain emulation: a line is driven low as an output, and released
+ *	(pulled up externally) by making it an input.
+ */
+static void
+releaseLine(uint32_t pin)
+{
+	GPIO_HAL_SetPinDir(GPIOB_BASE, pin, kGpioDigitalInput);
+}
+
+static void
+pullLineLow(uint32_t pin)
+{
+	GPIO_HAL_ClearPinOutput(GPIOB_BASE, pin);
+	GPIO_HAL_SetPinDir(GPIOB_BASE, pin, kGpioDigitalOutput);
+}
+
+static bool
+sdaIsHigh(void)
+{
+	return GPIO_HAL_ReadPinInput(GPIOB_BASE, kWarpI2CSdaPin);
+}
+
+/*
+ *	Take I2C0 off PTB3/PTB4, clock SCL until whichever slave is holding
+ *	SDA low finishes its byte (at most 9 clocks: 8 data bits and the ACK),
+ *	then send a STOP by hand and re-initialize the peripheral. The
+ *	re-initialization also clears a module left mid-transfer by a timeout.
+ *
+ *	Interrupts are masked throughout (about 100us at 100kHz) so the
+ *	acquisition ISR cannot touch the peripheral while it is down.
+ */
+WarpStatus
+warpI2CBusRecover(void)
+{
+	i2c_master_state_t *	master = (i2c_master_state_t *)g_i2cStatePtr[0];
+	uint32_t		primask;
+	bool			released;
+
+
+	if (master == NULL)
+	{
+		return kWarpStatusDeviceNotInitialized;
+	}
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	I2C_DRV_MasterDeinit(0);
+
+	releaseLine(kWarpI2CSclPin);
+	releaseLine(kWarpI2CSdaPin);
+	PORT_HAL_SetMuxMode(PORTB_BASE, kWarpI2CSclPin, kPortMuxAsGpio);
+	PORT_HAL_SetMuxMode(PORTB_BASE, kWarpI2CSdaPin, kPortMuxAsGpio);
+	OSA_TimeDelayUs(kWarpI2CRecoveryHalfPeriodMicroseconds);
+
+	for (uint8_t i = 0; (i < kWarpI2CRecoveryClockPulses) && !sdaIsHigh(); i++)
+	{
+		pullLineLow(kWarpI2CSclPin);
+		OSA_TimeDelayUs(kWarpI2CRecoveryHalfPeriodMicroseconds);
+		releaseLine(kWarpI2CSclPin);
+		OSA_TimeDelayUs(kWarpI2CRecoveryHalfPeriodMicroseconds);
+	}
+	released = sdaIsHigh();
+
+	/*
+	 *	STOP: SDA rises while SCL is high.
+	 */
+	pullLineLow(kWarpI2CSclPin);
+	OSA_TimeDelayUs(kWarpI2CRecoveryHalfPeriodMicroseconds);
+	pullLineLow(kWarpI2CSdaPin);
+	OSA_TimeDelayUs(kWarpI2CRecoveryHalfPeriodMicroseconds);
+	releaseLine(kWarpI2CSclPin);
+	OSA_TimeDelayUs(kWarpI2CRecoveryHalfPeriodMicroseconds);
+	releaseLine(kWarpI2CSdaPin);
+	OSA_TimeDelayUs(kWarpI2CRecoveryHalfPeriodMicroseconds);
+
+	PORT_HAL_SetMuxMode(PORTB_BASE, kWarpI2CSclPin, kPortMuxAlt2);
+	PORT_HAL_SetMuxMode(PORTB_BASE, kWarpI2CSdaPin, kPortMuxAlt2);
+	I2C_DRV_MasterInit(0, master);
+
+	__set_PRIMASK(primask);
+
+	busHealth.recoveries++;
+	if (!released)
+	{
+		busHealth.recoveriesFailed++;
+
+		return kWarpStatusCommsError;
+	}
+
+	return kWarpStatusOK;
+}
+
+void
+warpI2CSetRetryPolicy(uint8_t maxRetries, uint16_t backoffMicroseconds)
+{
+	retryPolicy.maxRetries		= maxRetries;
+	retryPolicy.backoffMicroseconds	= backoffMicroseconds;
+}
+
+const WarpI2CRetryPolicy *
+warpI2CGetRetryPolicy(void)
+{
+	return &retryPolicy;
+}
+
+/*
+ *	Count the outcome of transfer attempt number attempt (from 0) against
+ *	the device. Returns true if the caller should try again, after the
+ *	bus has been recovered if necessary and the backoff has elapsed.
+ */
+bool
+warpI2CRetryAfter(WarpI2CDeviceState volatile *  deviceStatePointer, i2c_status_t status, uint8_t attempt)
+{
+	volatile WarpI2CHealth *	health = &deviceStatePointer->health;
+
+
+	switch (status)
+	{
+		case kStatus_I2C_Success:
+		{
+			health->successCount++;
+
+			return false;
+		}
+
+		case kStatus_I2C_ReceivedNak:
+		{
+			health->nakCount++;
+			break;
+		}
+
+		case kStatus_I2C_Timeout:
+		{
+			health->timeoutCount++;
+			break;
+		}
+
+		default:
+		{
+			health->busErrorCount++;
+			break;
+		}
+	}
+
+	if ((__get_IPSR() != 0) || (attempt >= retryPolicy.maxRetries))
+	{
+		return false;
+	}
+
+	if ((status == kStatus_I2C_Timeout) || (status == kStatus_I2C_AribtrationLost) || (status == kStatus_I2C_StopSignalFail))
+	{
+		warpI2CBusRecover();
+	}
+
+	health->retryCount++;
+	OSA_TimeDelayUs((uint32_t)retryPolicy.backoffMicroseconds << attempt);
+
+	return true;
+}
+
+const WarpI2CBusHealth *
+warpI2CGetBusHealth(void)
+{
+	return &busHealth;
+}
+
+void
+warpI2CPrintHealth(const char *  name, WarpI2CDeviceState volatile *  deviceStatePointer)
+{
+	SEGGER_RTT_printf(0, "I2C %s: %u ok, %u nak, %u timeout, %u bus error, %u retries; bus %u recoveries, %u failed\n",
+				name,
+				deviceStatePointer->health.successCount,
+				deviceStatePointer->health.nakCount,
+				deviceStatePointer->health.timeoutCount,
+				deviceStatePointer->health.busErrorCount,
+				deviceStatePointer->health.retryCount,
+				busHealth.recoveries,
+				busHealth.recoveriesFailed);
+}
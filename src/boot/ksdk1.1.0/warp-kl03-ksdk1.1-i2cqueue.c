@@ -0,0 +1,395 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fsl_i2c_master_driver.h"
+#include "fsl_i2c_shared_function.h"
+#include "fsl_os_abstraction.h"
+
+#include "warp.h"
+
+
+/*
+ *	Interrupt-driven I2C transaction queue.
+ *
+ *	KSDK's I2C_DRV_MasterSendData()/ReceiveData() only return early for
+ *	the data phase: the address and register pointer still go out through
+ *	I2C_DRV_MasterWait(), so transfers cannot be started from the I2C
+ *	interrupt. The queue drives the I2C0 HAL directly instead.
+ *	I2C0_IRQHandler() below (fsl_i2c_irq.c is not linked in) runs the
+ *	queue while it owns the bus and passes every other interrupt to the
+ *	KSDK driver, so the blocking calls keep working whenever the queue is
+ *	empty.
+ *
+ *	A transaction is START, address+W, register, then either the data
+ *	bytes or a repeated START, address+R and the data, then STOP. As soon
+ *	as one completes, the next queued one is started from the same
+ *	interrupt.
+ */
+
+typedef enum
+{
+	kWarpI2CQueueStateIdle,
+	kWarpI2CQueueStateAddressWrite,
+	kWarpI2CQueueStateRegister,
+	kWarpI2CQueueStateAddressRead,
+	kWarpI2CQueueStateWriteData,
+	kWarpI2CQueueStateReadData,
+} WarpI2CQueueState;
+
+static WarpI2CTransaction *		head;
+static WarpI2CTransaction *		tail;
+static volatile WarpI2CQueueState	state = kWarpI2CQueueStateIdle;
+static uint8_t				byteIndex;
+static WarpI2CQueueStatistics		statistics;
+
+
+
+static i2c_master_state_t *
+masterState(void)
+{
+	return (i2c_master_state_t *)g_i2cStatePtr[0];
+}
+
+/*
+ *	Called with the queue's interrupt unable to run (from the ISR itself,
+ *	or with interrupts masked).
+ */
+static void
+startTransaction(WarpI2CTransaction *  transaction)
+{
+	i2c_device_t	slave;
+
+
+	/*
+	 *	Keep the KSDK driver off the bus until the queue drains. The queue
+	 *	now owns the bus, so it can set the device's speed from its cached
+	 *	divider, as a register map access would.
+	 */
+	masterState()->i2cIdle = false;
+	warpI2CSelectDevice(transaction->deviceStatePointer, &slave);
+
+	byteIndex = 0;
+	I2C_HAL_SetDirMode(I2C0_BASE, kI2CSend);
+	I2C_HAL_ClearInt(I2C0_BASE);
+	I2C_HAL_SetIntCmd(I2C0_BASE, true);
+
+	state = kWarpI2CQueueStateAddressWrite;
+	I2C_HAL_SendStart(I2C0_BASE);
+	I2C_HAL_WriteByte(I2C0_BASE, slave.address << 1);
+}
+
+/*
+ *	The STOP has already been sent. Retire the head transaction and start
+ *	the next one straight away, or hand the bus back to the KSDK driver.
+ */
+static void
+finishTransaction(WarpStatus status)
+{
+	WarpI2CTransaction *	transaction = head;
+
+
+	head = transaction->next;
+	if (head == NULL)
+	{
+		tail = NULL;
+	}
+
+	if (status == kWarpStatusOK)
+	{
+		statistics.transactionsCompleted++;
+	}
+	else
+	{
+		statistics.transactionsFailed++;
+	}
+
+	transaction->next = NULL;
+	transaction->status = status;
+
+	/*
+	 *	The callback may submit more work; it is appended behind head and
+	 *	picked up below.
+	 */
+	if (transaction->callback != NULL)
+	{
+		transaction->callback(transaction);
+	}
+
+	if (head != NULL)
+	{
+		startTransaction(head);
+
+		return;
+	}
+
+	I2C_HAL_SetIntCmd(I2C0_BASE, false);
+	state = kWarpI2CQueueStateIdle;
+	masterState()->i2cIdle = true;
+}
+
+static void
+stopTransaction(WarpStatus status)
+{
+	I2C_HAL_SendStop(I2C0_BASE);
+	finishTransaction(status);
+}
+
+static void
+serviceQueue(void)
+{
+	WarpI2CTransaction *	transaction = head;
+
+
+	I2C_HAL_ClearInt(I2C0_BASE);
+
+	if (I2C_HAL_GetStatusFlag(I2C0_BASE, kI2CArbitrationLost))
+	{
+		I2C_HAL_ClearArbitrationLost(I2C0_BASE);
+		stopTransaction(kWarpStatusCommsError);
+
+		return;
+	}
+
+	if ((state != kWarpI2CQueueStateReadData) && I2C_HAL_GetStatusFlag(I2C0_BASE, kI2CReceivedNak))
+	{
+		stopTransaction(kWarpStatusDeviceCommunicationFailed);
+
+		return;
+	}
+
+	switch (state)
+	{
+		case kWarpI2CQueueStateAddressWrite:
+		{
+			state = kWarpI2CQueueStateRegister;
+			I2C_HAL_WriteByte(I2C0_BASE, transaction->deviceRegister);
+
+			break;
+		}
+
+		case kWarpI2CQueueStateRegister:
+		{
+			if (transaction->direction == kWarpI2CTransactionRead)
+			{
+				state = kWarpI2CQueueStateAddressRead;
+				I2C_HAL_SendStart(I2C0_BASE);
+				I2C_HAL_WriteByte(I2C0_BASE, (transaction->deviceStatePointer->i2cAddress << 1) | 1U);
+			}
+			else if (transaction->length == 0)
+			{
+				stopTransaction(kWarpStatusOK);
+			}
+			else
+			{
+				state = kWarpI2CQueueStateWriteData;
+				I2C_HAL_WriteByte(I2C0_BASE, transaction->buffer[byteIndex++]);
+			}
+
+			break;
+		}
+
+		case kWarpI2CQueueStateWriteData:
+		{
+			if (byteIndex == transaction->length)
+			{
+				stopTransaction(kWarpStatusOK);
+			}
+			else
+			{
+				I2C_HAL_WriteByte(I2C0_BASE, transaction->buffer[byteIndex++]);
+			}
+
+			break;
+		}
+
+		case kWarpI2CQueueStateAddressRead:
+		{
+			state = kWarpI2CQueueStateReadData;
+			I2C_HAL_SetDirMode(I2C0_BASE, kI2CReceive);
+
+			/*
+			 *	NAK the byte after this one if it is the last. The dummy
+			 *	read clocks in the first byte.
+			 */
+			if (transaction->length == 1)
+			{
+				I2C_HAL_SendNak(I2C0_BASE);
+			}
+			else
+			{
+				I2C_HAL_SendAck(I2C0_BASE);
+			}
+			I2C_HAL_ReadByte(I2C0_BASE);
+
+			break;
+		}
+
+		case kWarpI2CQueueStateReadData:
+		{
+			/*
+			 *	As in the KSDK driver: STOP before reading the last byte,
+			 *	so reading the data register doesn't clock in another.
+			 */
+			if (byteIndex == transaction->length - 1)
+			{
+				I2C_HAL_SendStop(I2C0_BASE);
+				transaction->buffer[byteIndex] = I2C_HAL_ReadByte(I2C0_BASE);
+				finishTransaction(kWarpStatusOK);
+
+				break;
+			}
+
+			if (byteIndex == transaction->length - 2)
+			{
+				I2C_HAL_SendNak(I2C0_BASE);
+			}
+			else
+			{
+				I2C_HAL_SendAck(I2C0_BASE);
+			}
+			transaction->buffer[byteIndex++] = I2C_HAL_ReadByte(I2C0_BASE);
+
+			break;
+		}
+
+		default:
+		{
+			break;
+		}
+	}
+}
+
+/*
+ *	Override the I2C0 IRQ handler (fsl_i2c_irq.c is not linked in).
+ */
+void
+I2C0_IRQHandler(void)
+{
+	if (state != kWarpI2CQueueStateIdle)
+	{
+		serviceQueue();
+	}
+	else
+	{
+		I2C_DRV_IRQHandler(HW_I2C0);
+	}
+}
+
+/*
+ *	Append a transaction, starting the bus if the queue was empty. Safe to
+ *	call from a completion callback. Returns kWarpStatusBusy (and queues
+ *	nothing) if a blocking KSDK transfer currently has the bus.
+ */
+WarpStatus
+warpI2CQueueSubmit(WarpI2CTransaction *  transaction)
+{
+	uint32_t	primask;
+
+
+	if (masterState() == NULL)
+	{
+		return kWarpStatusDeviceNotInitialized;
+	}
+
+	if ((transaction->direction == kWarpI2CTransactionRead) && (transaction->length == 0))
+	{
+		return kWarpStatusBadDeviceCommand;
+	}
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	if ((state == kWarpI2CQueueStateIdle) && !masterState()->i2cIdle)
+	{
+		__set_PRIMASK(primask);
+
+		return kWarpStatusBusy;
+	}
+
+	transaction->status = kWarpStatusBusy;
+	transaction->next = NULL;
+
+	if (tail == NULL)
+	{
+		head = transaction;
+	}
+	else
+	{
+		tail->next = transaction;
+	}
+	tail = transaction;
+
+	if (state == kWarpI2CQueueStateIdle)
+	{
+		startTransaction(head);
+	}
+
+	__set_PRIMASK(primask);
+
+	return kWarpStatusOK;
+}
+
+bool
+warpI2CQueueIsIdle(void)
+{
+	return state == kWarpI2CQueueStateIdle;
+}
+
+/*
+ *	Sleep in WAIT until the queue drains. Interrupts are masked around the
+ *	check so a completion between the check and WFI still wakes the core.
+ *	On timeout the bus is released and every outstanding transaction is
+ *	failed without its callback.
+ */
+WarpStatus
+warpI2CQueueWait(uint32_t timeoutMilliseconds)
+{
+	uint64_t		startMicroseconds = OSA_TimeGetUsec();
+	WarpI2CTransaction *	transaction;
+	uint32_t		primask;
+
+
+	while (state != kWarpI2CQueueStateIdle)
+	{
+		if ((OSA_TimeGetUsec() - startMicroseconds) > (uint64_t)timeoutMilliseconds * 1000)
+		{
+			primask = __get_PRIMASK();
+			__disable_irq();
+
+			I2C_HAL_SetIntCmd(I2C0_BASE, false);
+			I2C_HAL_SendStop(I2C0_BASE);
+
+			for (transaction = head; transaction != NULL; transaction = transaction->next)
+			{
+				transaction->status = kWarpStatusDeviceCommunicationFailed;
+				statistics.transactionsAborted++;
+			}
+			head = NULL;
+			tail = NULL;
+
+			state = kWarpI2CQueueStateIdle;
+			masterState()->i2cIdle = true;
+
+			__set_PRIMASK(primask);
+
+			return kWarpStatusDeviceCommunicationFailed;
+		}
+
+		primask = __get_PRIMASK();
+		__disable_irq();
+		if (state != kWarpI2CQueueStateIdle)
+		{
+			SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+			__WFI();
+		}
+		__set_PRIMASK(primask);
+	}
+
+	return kWarpStatusOK;
+}
+
+const WarpI2CQueueStatistics *
+warpI2CQueueGetStatistics(void)
+{
+	return &statistics;
+}
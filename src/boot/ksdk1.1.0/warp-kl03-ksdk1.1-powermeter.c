@@ -0,0 +1,533 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "warp.h"
+
+
+/*
+ *	Integer-only RMS and power computation.
+ *
+ *	The KL03's Cortex-M0+ has no FPU, so the previous double-precision
+ *	sum-of-squares and sqrt() pulled in soft-float libm on every window.
+ *	Everything here is plain 32/64-bit integer arithmetic.
+ */
+
+
+
+/*
+ *	Bit-by-bit integer square root. Returns floor(sqrt(value)).
+ */
+uint32_t
+warpSquareRoot64(uint64_t value)
+{
+	uint64_t	root = 0;
+	uint64_t	bit = (uint64_t)1 << 62;
+
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+
+	while (bit != 0)
+	{
+		if (value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+
+		bit >>= 2;
+	}
+
+	return (uint32_t)root;
+}
+
+void
+warpRmsReset(WarpRmsAccumulator *  accumulator)
+{
+	accumulator->sumOfSquares	= 0;
+	accumulator->sampleCount	= 0;
+}
+
+void
+warpRmsAddSample(WarpRmsAccumulator *  accumulator, int32_t sample)
+{
+	/*
+	 *	Squares are summed at full precision. Dividing each term by the
+	 *	sample count before summing (as the old loop did) truncated small
+	 *	currents to zero.
+	 */
+	accumulator->sumOfSquares += (uint64_t)((int64_t)sample * sample);
+	accumulator->sampleCount++;
+}
+
+/*
+ *	RMS of the accumulated samples, in Q8 (i.e., 256 == one register LSB).
+ *
+ *	sumOfSquares is at most 2^30 per 16-bit sample, so the shift below cannot
+ *	overflow for fewer than 2^17 samples.
+ */
+uint32_t
+warpRmsGetQ8(WarpRmsAccumulator *  accumulator)
+{
+	if (accumulator->sampleCount == 0)
+	{
+		return 0;
+	}
+
+	return warpSquareRoot64((accumulator->sumOfSquares << 16) / accumulator->sampleCount);
+}
+
+/*
+ *	Scale an RMS value in Q8 by a Q16 watts-per-LSB factor, rounding to the
+ *	nearest watt. Saturates rather than wrapping negative for the largest
+ *	inputs.
+ */
+int32_t
+warpPowerFromRmsQ8(uint32_t rmsQ8, uint32_t scaleQ16)
+{
+	uint64_t	power = (((uint64_t)rmsQ8 * scaleQ16) + (1 << 23)) >> 24;
+
+	return (power > INT32_MAX) ? INT32_MAX : (int32_t)power;
+}
+
+/*
+ *	As warpPowerFromRmsQ8(), in milliwatts, for energy integration.
+ */
+uint32_t
+warpPowerMilliwattsFromRmsQ8(uint32_t rmsQ8, uint32_t scaleQ16)
+{
+	return (uint32_t)((((uint64_t)rmsQ8 * scaleQ16 * 1000) + (1 << 23)) >> 24);
+}
+
+
+
+/*
+ *	Streaming window statistics.
+ *
+ *	An incremental (Welford) accumulator that updates in O(1) time and memory
+ *	per sample, so windows can be characterised without keeping the samples.
+ *	Accumulators for consecutive windows can be merged to give the same
+ *	statistics over a longer period.
+ */
+void
+warpStatisticsReset(WarpStatisticsAccumulator volatile *  statistics)
+{
+	statistics->sampleCount	= 0;
+	statistics->meanQ8	= 0;
+	statistics->m2Q8	= 0;
+	statistics->minimum	= 0;
+	statistics->maximum	= 0;
+}
+
+void
+warpStatisticsAddSample(WarpStatisticsAccumulator volatile *  statistics, int32_t sample)
+{
+	int32_t		sampleQ8 = sample * 256;
+	int32_t		deltaQ8;
+
+	statistics->sampleCount++;
+
+	if (statistics->sampleCount == 1)
+	{
+		statistics->minimum = sample;
+		statistics->maximum = sample;
+	}
+	else if (sample < statistics->minimum)
+	{
+		statistics->minimum = sample;
+	}
+	else if (sample > statistics->maximum)
+	{
+		statistics->maximum = sample;
+	}
+
+	/*
+	 *	delta and (sample - updated mean) always have the same sign, so the
+	 *	product added to m2 is never negative.
+	 */
+	deltaQ8 = sampleQ8 - statistics->meanQ8;
+	statistics->meanQ8 += deltaQ8 / (int32_t)statistics->sampleCount;
+	statistics->m2Q8 += (uint64_t)((int64_t)deltaQ8 * (sampleQ8 - statistics->meanQ8)) >> 8;
+}
+
+/*
+ *	Combine two accumulators (Chan et al.'s parallel form of Welford's update).
+ */
+void
+warpStatisticsMerge(WarpStatisticsAccumulator *  into, const WarpStatisticsAccumulator *  from)
+{
+	uint32_t	totalCount;
+	int32_t		deltaQ8;
+	uint64_t	deltaSquaredQ8;
+
+	if (from->sampleCount == 0)
+	{
+		return;
+	}
+
+	if (into->sampleCount == 0)
+	{
+		*into = *from;
+
+		return;
+	}
+
+	totalCount	= into->sampleCount + from->sampleCount;
+	deltaQ8		= from->meanQ8 - into->meanQ8;
+	deltaSquaredQ8	= (uint64_t)((int64_t)deltaQ8 * deltaQ8) >> 8;
+
+	into->meanQ8	+= (int32_t)(((int64_t)deltaQ8 * from->sampleCount) / totalCount);
+	into->m2Q8	+= from->m2Q8 + ((deltaSquaredQ8 * from->sampleCount) / totalCount) * into->sampleCount;
+	into->minimum	= min(into->minimum, from->minimum);
+	into->maximum	= max(into->maximum, from->maximum);
+	into->sampleCount = totalCount;
+}
+
+int32_t
+warpStatisticsGetMeanQ8(const WarpStatisticsAccumulator *  statistics)
+{
+	return statistics->meanQ8;
+}
+
+/*
+ *	Population variance, in Q8 register LSBs squared.
+ */
+uint64_t
+warpStatisticsGetVarianceQ8(const WarpStatisticsAccumulator *  statistics)
+{
+	if (statistics->sampleCount == 0)
+	{
+		return 0;
+	}
+
+	return statistics->m2Q8 / statistics->sampleCount;
+}
+
+/*
+ *	RMS in Q8, from mean^2 + variance, so it needs no separate sum of squares.
+ */
+uint32_t
+warpStatisticsGetRmsQ8(const WarpStatisticsAccumulator *  statistics)
+{
+	uint64_t	meanSquareQ8;
+
+	meanSquareQ8 = ((uint64_t)((int64_t)statistics->meanQ8 * statistics->meanQ8) >> 8) + warpStatisticsGetVarianceQ8(statistics);
+
+	return warpSquareRoot64(meanSquareQ8 << 8);
+}
+
+uint32_t
+warpStatisticsGetPeak(const WarpStatisticsAccumulator *  statistics)
+{
+	uint32_t	negativePeak = (statistics->minimum < 0) ? (uint32_t)(-statistics->minimum) : 0;
+	uint32_t	positivePeak = (statistics->maximum > 0) ? (uint32_t)statistics->maximum : 0;
+
+	return (negativePeak > positivePeak) ? negativePeak : positivePeak;
+}
+
+uint32_t
+warpStatisticsGetPeakToPeak(const WarpStatisticsAccumulator *  statistics)
+{
+	return (uint32_t)(statistics->maximum - statistics->minimum);
+}
+
+/*
+ *	Peak / RMS, in Q8 (256 == 1.0; a sine wave is about 362).
+ */
+uint32_t
+warpStatisticsGetCrestFactorQ8(const WarpStatisticsAccumulator *  statistics)
+{
+	uint32_t	rmsQ8 = warpStatisticsGetRmsQ8(statistics);
+
+	if (rmsQ8 == 0)
+	{
+		return 0;
+	}
+
+	return (uint32_t)(((uint64_t)warpStatisticsGetPeak(statistics) << 16) / rmsQ8);
+}
+
+
+
+/*
+ *	Mains-cycle-synchronised RMS.
+ *
+ *	A fixed-length window holds a fractional number of mains cycles, so its
+ *	RMS beats against the line frequency. Here each result instead spans
+ *	exactly kWarpCycleRmsCyclesPerResult cycles, from one rising zero
+ *	crossing to another. Crossing times are interpolated between the two
+ *	samples either side of zero, and the sum of squares is divided by that
+ *	fractional duration rather than by a whole sample count. Results span
+ *	acquisition windows; samples just carry on from one window to the next.
+ */
+void
+warpCycleRmsReset(WarpCycleRmsAccumulator *  accumulator)
+{
+	memset(accumulator, 0, sizeof(WarpCycleRmsAccumulator));
+}
+
+/*
+ *	Abandon the result in progress after a gap in the samples, keeping the
+ *	last result. Tracking locks again at the next rising crossing.
+ */
+void
+warpCycleRmsRestart(WarpCycleRmsAccumulator *  accumulator)
+{
+	accumulator->locked		= false;
+	accumulator->armed		= false;
+	accumulator->sumOfSquares	= 0;
+	accumulator->sampleCount	= 0;
+	accumulator->cycleCount		= 0;
+}
+
+static void
+cycleRmsFinish(WarpCycleRmsAccumulator *  accumulator, uint32_t durationQ8, bool locked)
+{
+	if (durationQ8 > 0)
+	{
+		accumulator->rmsQ8 = warpSquareRoot64((accumulator->sumOfSquares << 24) / durationQ8);
+	}
+
+	accumulator->periodQ8		= locked ? (durationQ8 / kWarpCycleRmsCyclesPerResult) : 0;
+	accumulator->resultLocked	= locked;
+	accumulator->resultCount++;
+
+	accumulator->sumOfSquares	= 0;
+	accumulator->sampleCount	= 0;
+	accumulator->cycleCount		= 0;
+}
+
+/*
+ *	Returns true when the sample completes a new result.
+ */
+bool
+warpCycleRmsAddSample(WarpCycleRmsAccumulator *  accumulator, int32_t sample)
+{
+	bool		resultReady = false;
+	int32_t		crossingFractionQ8;
+
+
+	if (sample < -kWarpCycleRmsHysteresis)
+	{
+		accumulator->armed = true;
+	}
+	else if (accumulator->armed && (sample >= 0))
+	{
+		/*
+		 *	Rising crossing between the previous (negative) sample and this
+		 *	one. The fraction is where in that sample period it fell.
+		 */
+		accumulator->armed = false;
+		crossingFractionQ8 = (-accumulator->previousSample * 256) / (sample - accumulator->previousSample);
+
+		if (!accumulator->locked)
+		{
+			accumulator->locked		= true;
+			accumulator->sumOfSquares	= 0;
+			accumulator->sampleCount	= 0;
+			accumulator->cycleCount		= 0;
+		}
+		else if (++accumulator->cycleCount == kWarpCycleRmsCyclesPerResult)
+		{
+			cycleRmsFinish(accumulator,
+					accumulator->sampleCount * 256 + crossingFractionQ8 - accumulator->startFractionQ8,
+					true);
+			resultReady = true;
+		}
+
+		if (accumulator->cycleCount == 0)
+		{
+			accumulator->startFractionQ8 = crossingFractionQ8;
+		}
+	}
+
+	accumulator->sumOfSquares += (uint64_t)((int64_t)sample * sample);
+	accumulator->sampleCount++;
+	accumulator->previousSample = sample;
+
+	if (accumulator->sampleCount >= kWarpCycleRmsMaxSamples)
+	{
+		/*
+		 *	No mains cycles (DC, or a signal inside the hysteresis band):
+		 *	report the plain RMS and try to lock again.
+		 */
+		accumulator->locked = false;
+		cycleRmsFinish(accumulator, accumulator->sampleCount * 256, false);
+		resultReady = true;
+	}
+
+	return resultReady;
+}
+
+uint32_t
+warpCycleRmsGetFrequencyCentihertz(const WarpCycleRmsAccumulator *  accumulator, uint32_t samplePeriodMicroseconds)
+{
+	if (accumulator->periodQ8 == 0)
+	{
+		return 0;
+	}
+
+	return (uint32_t)(((uint64_t)100000000 * 256) / ((uint64_t)accumulator->periodQ8 * samplePeriodMicroseconds));
+}
+
+
+
+/*
+ *	Harmonic analysis.
+ *
+ *	A bank of Goertzel filters, one per odd harmonic, fed one sample at a
+ *	time over a block of whole mains cycles (as delimited by the cycle RMS
+ *	accumulator), so each harmonic falls on a bin centre and does not leak
+ *	into its neighbours. State is 32-bit; the coefficient products are
+ *	64-bit, about a dozen cycles per harmonic per sample on the M0+.
+ */
+
+/*
+ *	cos(2*pi*angle) in Q14, angle in turns Q16. Quarter-wave 5th-order
+ *	polynomial for sin(pi/2 * z), exact at z = 1; worst-case error is
+ *	about 2e-4 (2.1e-4 after Q14 truncation).
+ */
+int32_t
+warpCosineQ14(uint16_t angleTurnsQ16)
+{
+	uint16_t	angle = angleTurnsQ16 + 0x4000;
+	int32_t		zQ14;
+	int32_t		z2Q14;
+	int32_t		sineQ14;
+	bool		negate = (angle & 0x8000) != 0;
+
+	/*
+	 *	sin over the first half turn is symmetric about the quarter turn.
+	 */
+	angle &= 0x7FFF;
+	if (angle > 0x4000)
+	{
+		angle = 0x8000 - angle;
+	}
+
+	zQ14	= angle;
+	z2Q14	= (zQ14 * zQ14) >> 14;
+
+	/*
+	 *	z * (1.5704128 - z^2 * (0.6427144 - 0.0723016 * z^2))
+	 */
+	sineQ14 = 10530 - ((1185 * z2Q14) >> 14);
+	sineQ14 = 25730 - ((sineQ14 * z2Q14) >> 14);
+	sineQ14 = (sineQ14 * zQ14) >> 14;
+
+	/*
+	 *	The Q14 coefficients overshoot by one LSB at z = 1. Clamp, so that
+	 *	a Goertzel coefficient never exceeds 2 and its filter never grows.
+	 */
+	if (sineQ14 > 16384)
+	{
+		sineQ14 = 16384;
+	}
+
+	return negate ? -sineQ14 : sineQ14;
+}
+
+/*
+ *	Set up the filters for a fundamental of one cycle per periodQ8 samples,
+ *	and clear their state for a new block.
+ */
+void
+warpHarmonicsTune(WarpHarmonicAnalyser *  analyser, uint32_t periodQ8)
+{
+	analyser->harmonicsInBand = 0;
+
+	for (uint8_t i = 0; i < kWarpHarmonicsCount; i++)
+	{
+		uint32_t	harmonic = 2 * i + 1;
+		uint32_t	turnsQ16 = (periodQ8 == 0) ? 0x10000 : (uint32_t)(((uint64_t)harmonic << 24) / periodQ8);
+
+		analyser->s1[i] = 0;
+		analyser->s2[i] = 0;
+
+		if (turnsQ16 < kWarpHarmonicsMaxTurnsQ16)
+		{
+			analyser->coefficientQ14[i] = 2 * warpCosineQ14((uint16_t)turnsQ16);
+			analyser->harmonicsInBand = i + 1;
+		}
+	}
+
+	analyser->sampleCount	= 0;
+	analyser->tuned		= (analyser->harmonicsInBand > 0);
+}
+
+void
+warpHarmonicsAddSample(WarpHarmonicAnalyser *  analyser, int32_t sample)
+{
+	for (uint8_t i = 0; i < analyser->harmonicsInBand; i++)
+	{
+		int32_t		s0 = sample + (int32_t)(((int64_t)analyser->coefficientQ14[i] * analyser->s1[i]) >> 14) - analyser->s2[i];
+
+		analyser->s2[i] = analyser->s1[i];
+		analyser->s1[i] = s0;
+	}
+
+	analyser->sampleCount++;
+}
+
+/*
+ *	Turn the filter states into harmonic amplitudes and THD. Returns false
+ *	if no block was being analysed.
+ */
+bool
+warpHarmonicsFinish(WarpHarmonicAnalyser *  analyser)
+{
+	uint64_t	harmonicPower = 0;
+	uint64_t	fundamentalPower = 0;
+
+	if (!analyser->tuned || (analyser->sampleCount == 0))
+	{
+		return false;
+	}
+
+	for (uint8_t i = 0; i < kWarpHarmonicsCount; i++)
+	{
+		int64_t		s1 = analyser->s1[i];
+		int64_t		s2 = analyser->s2[i];
+		int64_t		power;
+
+		if (i >= analyser->harmonicsInBand)
+		{
+			analyser->amplitudeQ8[i] = 0;
+			continue;
+		}
+
+		/*
+		 *	|X(k)|^2 = s1^2 + s2^2 - coefficient * s1 * s2; the peak amplitude
+		 *	of a bin-centred sinusoid is 2|X(k)|/N.
+		 */
+		power = s1 * s1 + s2 * s2 - ((analyser->coefficientQ14[i] * s1) >> 14) * s2;
+		if (power < 0)
+		{
+			power = 0;
+		}
+
+		analyser->amplitudeQ8[i] = (2 * warpSquareRoot64((uint64_t)power << 16)) / analyser->sampleCount;
+
+		if (i == 0)
+		{
+			fundamentalPower = power;
+		}
+		else
+		{
+			harmonicPower += power;
+		}
+	}
+
+	analyser->thdPerMille = (fundamentalPower == 0) ? 0 :
+				(uint32_t)(((uint64_t)warpSquareRoot64(harmonicPower) * 1000) / warpSquareRoot64(fundamentalPower));
+	analyser->tuned = false;
+	analyser->resultCount++;
+
+	return true;
+}
@@ -0,0 +1,161 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fsl_i2c_master_driver.h"
+
+#include "SEGGER_RTT.h"
+#include "warp.h"
+
+
+/*
+ *	Boot-time I2C bus scan and device registry.
+ *
+ *	Which drivers are built in is still chosen in the boot file, but which
+ *	of those devices are fitted is found out at boot: each compiled-in
+ *	device's probe is tried at its address (and alternate address), and
+ *	checked against its ID register where it has one. Callers then ask
+ *	warpI2CRegistryIsPresent() before configuring or reading a device, so
+ *	absent sensors cost one NAKed address byte at boot and nothing after.
+ */
+
+/*
+ *	Any register, one byte at a time, with the pointer advancing so that
+ *	two-byte IDs can be read in one go.
+ */
+static const WarpRegmap		probeRegmap =
+{
+	.registerCount	= 256,
+	.registerBytes	= 1,
+	.flags		= kWarpRegmapFlagAutoIncrement,
+	.readable	= NULL,
+	.writable	= NULL,
+};
+
+static const WarpI2CProbe *	registryProbes;
+static uint8_t			registryProbeCount;
+static uint32_t			presentMask;
+
+
+
+static bool
+answersAt(const WarpI2CProbe *  probe, uint8_t i2cAddress)
+{
+	volatile uint8_t *	id = probe->deviceStatePointer->i2cBuffer;
+
+
+	probe->deviceStatePointer->i2cAddress = i2cAddress;
+
+	if (probe->idBytes == 0)
+	{
+		return warpRegmapReadAgain(&probeRegmap, probe->deviceStatePointer, 1) == kWarpStatusOK;
+	}
+
+	if (warpRegmapRead(&probeRegmap, probe->deviceStatePointer, probe->idRegister, probe->idBytes) != kWarpStatusOK)
+	{
+		return false;
+	}
+
+	return ((probe->idBytes == 1) ? id[0] : ((id[0] << 8) | id[1])) == probe->idValue;
+}
+
+/*
+ *	Look for one device. On success its state holds the address that
+ *	answered. Retries are off (a NAK is the expected answer from an
+ *	absent device) and the probe doesn't count towards its health.
+ */
+bool
+warpI2CRegistryProbe(const WarpI2CProbe *  probe)
+{
+	WarpI2CRetryPolicy	policy = *warpI2CGetRetryPolicy();
+	WarpI2CHealth		health = probe->deviceStatePointer->health;
+	uint8_t			primaryAddress = probe->deviceStatePointer->i2cAddress;
+	bool			found;
+
+
+	warpI2CSetRetryPolicy(0, policy.backoffMicroseconds);
+
+	found = answersAt(probe, primaryAddress) ||
+		((probe->alternateAddress != 0) && answersAt(probe, probe->alternateAddress));
+	if (!found)
+	{
+		probe->deviceStatePointer->i2cAddress = primaryAddress;
+	}
+
+	probe->deviceStatePointer->health = health;
+	warpI2CSetRetryPolicy(policy.maxRetries, policy.backoffMicroseconds);
+
+	return found;
+}
+
+/*
+ *	An ACK-only probe can't tell its device from an earlier one at the same
+ *	address (e.g., AMG8834 and the BMX055 gyro at 0x68).
+ */
+static bool
+addressClaimed(uint8_t probeIndex)
+{
+	uint8_t		i2cAddress = registryProbes[probeIndex].deviceStatePointer->i2cAddress;
+
+
+	for (uint8_t i = 0; i < probeIndex; i++)
+	{
+		if ((presentMask & (1U << registryProbes[i].sensor)) &&
+			(registryProbes[i].deviceStatePointer->i2cAddress == i2cAddress))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ *	Probe every device in the table, in order, and record which answered.
+ *	The table must outlive the registry. Returns the present mask.
+ */
+uint32_t
+warpI2CRegistryScan(const WarpI2CProbe *  probes, uint8_t probeCount)
+{
+	registryProbes		= probes;
+	registryProbeCount	= probeCount;
+	presentMask		= 0;
+
+	for (uint8_t i = 0; i < probeCount; i++)
+	{
+		if (warpI2CRegistryProbe(&probes[i]) && ((probes[i].idBytes != 0) || !addressClaimed(i)))
+		{
+			presentMask |= 1U << probes[i].sensor;
+			probes[i].deviceStatePointer->deviceStatus = kWarpStatusOK;
+		}
+		else
+		{
+			probes[i].deviceStatePointer->deviceStatus = kWarpStatusDeviceNotInitialized;
+		}
+	}
+
+	return presentMask;
+}
+
+bool
+warpI2CRegistryIsPresent(WarpSensorDevice sensor)
+{
+	return (presentMask >> sensor) & 1;
+}
+
+void
+warpI2CRegistryPrint(void)
+{
+	SEGGER_RTT_WriteString(0, "I2C devices:");
+	for (uint8_t i = 0; i < registryProbeCount; i++)
+	{
+		if (warpI2CRegistryIsPresent(registryProbes[i].sensor))
+		{
+			SEGGER_RTT_printf(0, " %s@0x%02x", registryProbes[i].name, registryProbes[i].deviceStatePointer->i2cAddress);
+		}
+		else
+		{
+			SEGGER_RTT_printf(0, " %s:absent", registryProbes[i].name);
+		}
+	}
+	SEGGER_RTT_WriteString(0, "\n");
+}
@@ -0,0 +1,368 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fsl_i2c_master_driver.h"
+#include "fsl_i2c_shared_function.h"
+#include "fsl_i2c_hal.h"
+#include "fsl_clock_manager.h"
+
+#include "warp.h"
+
+
+/*
+ *	Register-map access for I2C devices.
+ *
+ *	Each driver used to carry its own switch over the valid registers, its
+ *	own i2c_device_t and its own blocking send/receive. Drivers now describe
+ *	their registers with a const WarpRegmap, and every register access goes
+ *	through the routines below. Reads are at most kWarpSizesI2cBufferBytes,
+ *	so they use the polled I2C_DRV_MasterReceiveDataFast() rather than the
+ *	interrupt-and-semaphore blocking receive. Every attempt is reported to
+ *	warpI2CRetryAfter(), which keeps the device's health counters and
+ *	applies the retry policy.
+ *
+ *	Each device state also carries its bus speed and the I2C_F value for
+ *	it. The KSDK driver only skips I2C_HAL_SetBaudRate() when the speed is
+ *	the same as last time; otherwise it searches the divider table, with a
+ *	software division per entry. Switching between devices at different
+ *	speeds now costs one register write instead.
+ */
+
+extern volatile uint32_t	gWarpI2cBaudRateKbps;
+extern volatile uint32_t	gWarpI2cTimeoutMilliseconds;
+
+/*
+ *	Slowest first: the slowest is the reference for warpRegmapTuneSpeed().
+ */
+static const uint16_t		tuneSpeedsKbps[] = {100, 200, 300, 400};
+
+
+
+static bool
+registerAllowed(const WarpRegmap *  map, const uint32_t *  bitmap, uint16_t deviceRegister)
+{
+	if (deviceRegister >= map->registerCount)
+	{
+		return false;
+	}
+
+	if (bitmap == NULL)
+	{
+		return true;
+	}
+
+	return (bitmap[deviceRegister >> 5] >> (deviceRegister & 0x1F)) & 1;
+}
+
+/*
+ *	A read may cover several registers only if the device auto-increments,
+ *	and must fit in i2cBuffer. Every register it touches must be readable.
+ */
+static bool
+readAllowed(const WarpRegmap *  map, uint8_t deviceRegister, int numberOfBytes)
+{
+	uint16_t	lastRegister;
+
+
+	if ((numberOfBytes < 1) || (numberOfBytes > kWarpSizesI2cBufferBytes))
+	{
+		return false;
+	}
+
+	if ((numberOfBytes > map->registerBytes) && !(map->flags & kWarpRegmapFlagAutoIncrement))
+	{
+		return false;
+	}
+
+	lastRegister = deviceRegister + (numberOfBytes - 1) / map->registerBytes;
+	for (uint16_t r = deviceRegister; r <= lastRegister; r++)
+	{
+		if (!registerAllowed(map, map->readable, r))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ *	Fill in the KSDK descriptor for the device and, if the bus is not
+ *	already at the device's speed, program the divider (from the cached
+ *	I2C_F value if it was worked out at the current I2C clock). Recording
+ *	the speed in lastBaudRate_kbps makes the driver's own
+ *	I2C_DRV_MasterSetBaudRate() return straight away. Interrupts are
+ *	masked so the acquisition ISR can't change the speed in between.
+ *
+ *	The caller must own the bus: the transaction queue when it starts a
+ *	transaction, or selectDevice() below once it has seen the bus idle.
+ */
+void
+warpI2CSelectDevice(WarpI2CDeviceState volatile *  deviceStatePointer, i2c_device_t *  slave)
+{
+	volatile WarpI2CDeviceSpeed *	speed = &deviceStatePointer->speed;
+	i2c_master_state_t *		master = (i2c_master_state_t *)g_i2cStatePtr[0];
+	uint32_t			clockHz;
+	uint32_t			primask;
+
+
+	slave->address		= deviceStatePointer->i2cAddress;
+	slave->baudRate_kbps	= (speed->baudRateKbps != 0) ? speed->baudRateKbps : gWarpI2cBaudRateKbps;
+
+	if ((master == NULL) || (master->lastBaudRate_kbps == slave->baudRate_kbps))
+	{
+		return;
+	}
+
+	clockHz = CLOCK_SYS_GetI2cFreq(0);
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	if ((speed->dividerKbps == slave->baudRate_kbps) && (speed->dividerClockKhz == clockHz / 1000))
+	{
+		HW_I2C_F_WR(I2C0_BASE, speed->frequencyDivider);
+	}
+	else
+	{
+		I2C_HAL_SetBaudRate(I2C0_BASE, clockHz, slave->baudRate_kbps, NULL);
+		speed->frequencyDivider	= HW_I2C_F_RD(I2C0_BASE);
+		speed->dividerKbps	= slave->baudRate_kbps;
+		speed->dividerClockKhz	= clockHz / 1000;
+	}
+	master->lastBaudRate_kbps = slave->baudRate_kbps;
+
+	__set_PRIMASK(primask);
+}
+
+/*
+ *	While the queue (or a transfer this call interrupted) has the bus, the
+ *	divider is left alone; the KSDK driver will refuse the transfer as busy.
+ */
+static void
+selectDevice(WarpI2CDeviceState volatile *  deviceStatePointer, i2c_device_t *  slave)
+{
+	i2c_master_state_t *	master = (i2c_master_state_t *)g_i2cStatePtr[0];
+
+
+	if ((master != NULL) && !master->i2cIdle)
+	{
+		slave->address		= deviceStatePointer->i2cAddress;
+		slave->baudRate_kbps	= master->lastBaudRate_kbps;
+
+		return;
+	}
+
+	warpI2CSelectDevice(deviceStatePointer, slave);
+}
+
+static WarpStatus
+receive(WarpI2CDeviceState volatile *  deviceStatePointer, const uint8_t *  pointerByte, int numberOfBytes)
+{
+	i2c_status_t	status;
+	i2c_device_t	slave;
+	uint8_t		attempt = 0;
+
+
+	do
+	{
+		selectDevice(deviceStatePointer, &slave);
+		status = I2C_DRV_MasterReceiveDataFast(
+								0 /* I2C peripheral instance */,
+								&slave,
+								pointerByte,
+								(pointerByte == NULL) ? 0 : 1,
+								(uint8_t *)deviceStatePointer->i2cBuffer,
+								numberOfBytes,
+								gWarpI2cTimeoutMilliseconds);
+	} while (warpI2CRetryAfter(deviceStatePointer, status, attempt++));
+
+	if (status != kStatus_I2C_Success)
+	{
+		return kWarpStatusDeviceCommunicationFailed;
+	}
+
+	return kWarpStatusOK;
+}
+
+/*
+ *	Write one register. payload is taken as registerBytes wide and sent in
+ *	the device's byte order.
+ */
+WarpStatus
+warpRegmapWrite(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t deviceRegister, uint16_t payload)
+{
+	uint8_t		payloadByte[2], commandByte[1];
+	i2c_status_t	status;
+	i2c_device_t	slave;
+	uint8_t		attempt = 0;
+
+
+	if (!registerAllowed(map, map->writable, deviceRegister))
+	{
+		return kWarpStatusBadDeviceCommand;
+	}
+
+	if (map->registerBytes == 1)
+	{
+		payloadByte[0] = payload;
+	}
+	else if (map->flags & kWarpRegmapFlagBigEndian)
+	{
+		payloadByte[0] = payload >> 8;
+		payloadByte[1] = payload & 0xFF;
+	}
+	else
+	{
+		payloadByte[0] = payload & 0xFF;
+		payloadByte[1] = payload >> 8;
+	}
+
+	commandByte[0] = deviceRegister;
+	do
+	{
+		selectDevice(deviceStatePointer, &slave);
+		status = I2C_DRV_MasterSendDataBlocking(
+								0 /* I2C instance */,
+								&slave,
+								commandByte,
+								1,
+								payloadByte,
+								map->registerBytes,
+								gWarpI2cTimeoutMilliseconds);
+	} while (warpI2CRetryAfter(deviceStatePointer, status, attempt++));
+
+	if (status != kStatus_I2C_Success)
+	{
+		return kWarpStatusDeviceCommunicationFailed;
+	}
+
+	return kWarpStatusOK;
+}
+
+/*
+ *	Read numberOfBytes starting at deviceRegister into i2cBuffer, as a
+ *	pointer write followed by a repeated start.
+ */
+WarpStatus
+warpRegmapRead(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t deviceRegister, int numberOfBytes)
+{
+	uint8_t		cmdBuf[1];
+
+
+	if (!readAllowed(map, deviceRegister, numberOfBytes))
+	{
+		return kWarpStatusBadDeviceCommand;
+	}
+
+	cmdBuf[0] = deviceRegister;
+
+	return receive(deviceStatePointer, cmdBuf, numberOfBytes);
+}
+
+/*
+ *	Read the register last addressed again, without the pointer write. Only
+ *	useful on devices whose pointer stays put between reads (e.g., for
+ *	polling a status register).
+ */
+WarpStatus
+warpRegmapReadAgain(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, int numberOfBytes)
+{
+	if ((numberOfBytes < 1) || (numberOfBytes > map->registerBytes))
+	{
+		return kWarpStatusBadDeviceCommand;
+	}
+
+	return receive(deviceStatePointer, NULL, numberOfBytes);
+}
+
+/*
+ *	The index'th register of the last read, assembled in the device's byte
+ *	order.
+ */
+uint16_t
+warpRegmapGetValue(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t index)
+{
+	volatile uint8_t *	bytes = &deviceStatePointer->i2cBuffer[index * map->registerBytes];
+
+
+	if (map->registerBytes == 1)
+	{
+		return bytes[0];
+	}
+
+	if (map->flags & kWarpRegmapFlagBigEndian)
+	{
+		return (bytes[0] << 8) | bytes[1];
+	}
+
+	return (bytes[1] << 8) | bytes[0];
+}
+
+static bool
+speedIsReliable(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t probeRegister, uint16_t reference, uint16_t readsPerSpeed)
+{
+	for (uint16_t i = 0; i < readsPerSpeed; i++)
+	{
+		if ((warpRegmapRead(map, deviceStatePointer, probeRegister, map->registerBytes) != kWarpStatusOK) ||
+			(warpRegmapGetValue(map, deviceStatePointer, 0) != reference))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ *	Set the device to the fastest of tuneSpeedsKbps at which readsPerSpeed
+ *	reads of probeRegister (which must not change between reads) all
+ *	succeed and match a read at the slowest speed. Retries are off while
+ *	tuning, and the health counters are put back afterwards. The margin
+ *	depends on the bus rise time, so tune again after changing the
+ *	pull-ups.
+ */
+WarpStatus
+warpRegmapTuneSpeed(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t probeRegister, uint16_t readsPerSpeed)
+{
+	WarpI2CRetryPolicy	policy = *warpI2CGetRetryPolicy();
+	WarpI2CHealth		health = deviceStatePointer->health;
+	uint16_t		previousKbps = deviceStatePointer->speed.baudRateKbps;
+	uint8_t			speedIndex;
+	uint16_t		reference;
+	WarpStatus		status;
+
+
+	warpI2CSetRetryPolicy(0, policy.backoffMicroseconds);
+
+	deviceStatePointer->speed.baudRateKbps = tuneSpeedsKbps[0];
+	status = warpRegmapRead(map, deviceStatePointer, probeRegister, map->registerBytes);
+	if (status != kWarpStatusOK)
+	{
+		deviceStatePointer->speed.baudRateKbps = previousKbps;
+	}
+	else
+	{
+		reference = warpRegmapGetValue(map, deviceStatePointer, 0);
+
+		for (speedIndex = sizeof(tuneSpeedsKbps) / sizeof(tuneSpeedsKbps[0]) - 1; speedIndex > 0; speedIndex--)
+		{
+			deviceStatePointer->speed.baudRateKbps = tuneSpeedsKbps[speedIndex];
+			if (speedIsReliable(map, deviceStatePointer, probeRegister, reference, readsPerSpeed))
+			{
+				break;
+			}
+
+			/*
+			 *	A failure at the edge can leave a slave holding SDA.
+			 */
+			warpI2CBusRecover();
+		}
+		deviceStatePointer->speed.baudRateKbps = tuneSpeedsKbps[speedIndex];
+	}
+
+	deviceStatePointer->health = health;
+	warpI2CSetRetryPolicy(policy.maxRetries, policy.backoffMicroseconds);
+
+	return status;
+}
@@ -1,6 +1,8 @@
 #include "fsl_spi_master_driver.h"
+#include "fsl_i2c_master_driver.h"
 
 #define	min(x,y)	((x) < (y) ? (x) : (y))
+#define	max(x,y)	((x) > (y) ? (x) : (y))
 #define	USED(x)		(void)(x)
 
 typedef enum
@@ -98,6 +100,16 @@ typedef enum
 	 */
 	kWarpStatusCommsError,
 
+	/*
+	 *	Device has not finished a new conversion since the last read
+	 */
+	kWarpStatusConversionNotReady,
+
+	/*
+	 *	Peripheral is in use by another transfer
+	 */
+	kWarpStatusBusy,
+
 	/*
 	 *	Power mode routines
 	 */
@@ -169,8 +181,71 @@ typedef enum
 	kWarpSizesI2cBufferBytes		= 4,
 	kWarpSizesSpiBufferBytes		= 3,
 	kWarpSizesBME680CalibrationValuesCount	= 41,
+	kWarpSizesINA219WindowSamples		= 50,
 } WarpSizes;
 
+typedef enum
+{
+	kWarpI2CRetryDefaultMaxRetries			= 2,
+	kWarpI2CRetryDefaultBackoffMicroseconds		= 50,
+
+	/*
+	 *	Enough clocks for a slave to finish any byte and its ACK, at
+	 *	about 100kHz.
+	 */
+	kWarpI2CRecoveryClockPulses			= 9,
+	kWarpI2CRecoveryHalfPeriodMicroseconds		= 5,
+} WarpI2CHealthConstants;
+
+/*
+ *	Per-device transfer outcomes, one count per attempt. A read that
+ *	succeeds on its second attempt shows up as one failure, one retry and
+ *	one success.
+ */
+typedef struct
+{
+	uint32_t		successCount;
+	uint16_t		nakCount;
+	uint16_t		timeoutCount;
+	uint16_t		busErrorCount;
+	uint16_t		retryCount;
+} WarpI2CHealth;
+
+typedef struct
+{
+	uint16_t		recoveries;
+	uint16_t		recoveriesFailed;
+} WarpI2CBusHealth;
+
+/*
+ *	A failed transfer is retried up to maxRetries times, waiting
+ *	backoffMicroseconds before the first retry and twice as long before
+ *	each one after that.
+ */
+typedef struct
+{
+	uint8_t			maxRetries;
+	uint16_t		backoffMicroseconds;
+} WarpI2CRetryPolicy;
+
+typedef enum
+{
+	kWarpI2CTuneReadsPerSpeed			= 32,
+} WarpI2CSpeedConstants;
+
+/*
+ *	A device's bus speed, and the I2C_F (MULT and ICR) value that gives it
+ *	at the I2C clock it was worked out for. A baudRateKbps of 0 follows
+ *	gWarpI2cBaudRateKbps.
+ */
+typedef struct
+{
+	uint16_t		baudRateKbps;
+	uint16_t		dividerKbps;
+	uint16_t		dividerClockKhz;
+	uint8_t			frequencyDivider;
+} WarpI2CDeviceSpeed;
+
 typedef struct
 {
 	uint8_t			i2cAddress;
@@ -178,8 +253,99 @@ typedef struct
 	uint8_t			i2cBuffer[kWarpSizesI2cBufferBytes];
 
 	WarpStatus		deviceStatus;
+	WarpI2CHealth		health;
+	WarpI2CDeviceSpeed	speed;
 } WarpI2CDeviceState;
 
+/*
+ *	How to recognise a device on the bus at boot. It is looked for first at
+ *	the address its init function put in the device state, then at
+ *	alternateAddress (0 for none). An idBytes-wide (1 or 2, MSB first) read
+ *	of idRegister must give idValue; devices with no ID register have
+ *	idBytes 0 and are taken to be present if they ACK, so they should come
+ *	after any ID-checked device that can share their address.
+ */
+typedef struct
+{
+	WarpSensorDevice		sensor;
+	const char *			name;
+	WarpI2CDeviceState volatile *	deviceStatePointer;
+	uint8_t				alternateAddress;
+	uint8_t				idRegister;
+	uint8_t				idBytes;
+	uint16_t			idValue;
+} WarpI2CProbe;
+
+typedef enum
+{
+	/*
+	 *	Multi-byte registers are sent MSB first.
+	 */
+	kWarpRegmapFlagBigEndian		= (1 << 0),
+
+	/*
+	 *	The register pointer advances after each register, so one
+	 *	transaction can read several consecutive registers.
+	 */
+	kWarpRegmapFlagAutoIncrement		= (1 << 1),
+} WarpRegmapFlag;
+
+/*
+ *	Constant description of an I2C device's register map, shared by every
+ *	instance of the device (the address lives in WarpI2CDeviceState). The
+ *	bitmaps have bit (r % 32) of word (r / 32) set when register r may be
+ *	read or written; a NULL bitmap allows every register below
+ *	registerCount.
+ */
+typedef struct
+{
+	uint16_t		registerCount;
+	uint8_t			registerBytes;
+	uint8_t			flags;
+	const uint32_t *	readable;
+	const uint32_t *	writable;
+} WarpRegmap;
+
+typedef enum
+{
+	kWarpI2CQueueWaitTimeoutMilliseconds	= 100,
+} WarpI2CQueueConstants;
+
+typedef enum
+{
+	kWarpI2CTransactionRead,
+	kWarpI2CTransactionWrite,
+} WarpI2CTransactionDirection;
+
+typedef struct WarpI2CTransaction	WarpI2CTransaction;
+typedef void				(*WarpI2CTransactionCallback)(WarpI2CTransaction *  transaction);
+
+/*
+ *	One queued register access. The submitter owns the storage for the
+ *	descriptor and its buffer until the callback has run (or status is no
+ *	longer kWarpStatusBusy). The callback runs in interrupt context.
+ */
+struct WarpI2CTransaction
+{
+	WarpI2CDeviceState volatile *	deviceStatePointer;
+	uint8_t				deviceRegister;
+	WarpI2CTransactionDirection	direction;
+	uint8_t *			buffer;
+	uint8_t				length;
+	WarpI2CTransactionCallback	callback;
+	void *				context;
+
+	volatile WarpStatus		status;
+	WarpI2CTransaction *		next;
+};
+
+typedef struct
+{
+	uint32_t	transactionsCompleted;
+	uint32_t	transactionsFailed;
+	uint32_t	transactionsAborted;
+} WarpI2CQueueStatistics;
+
 typedef enum
 {
 	kWarpSensorConfigurationRegisterMMA8451QF_SETUP			= 0x09,
@@ -341,8 +507,257 @@ typedef struct
 	uint8_t		outputBuffer[kWarpThermalChamberMMA8451QOutputBufferSize];
 } WarpThermalChamberKL03MemoryFill;
 
+typedef enum
+{
+	/*
+	 *	Watts per shunt-register LSB of RMS, in Q16. These are the empirical
+	 *	0.125 and 0.12 factors previously applied as doubles.
+	 */
+	kWarpPowerScaleQ16Display	= 8192,
+	kWarpPowerScaleQ16CsvStream	= 7864,
+} WarpPowerScale;
+
+typedef struct
+{
+	uint64_t	sumOfSquares;
+	uint32_t	sampleCount;
+} WarpRmsAccumulator;
+
+typedef enum
+{
+	/*
+	 *	Number of sample windows merged into each longer reporting period.
+	 */
+	kWarpStatisticsWindowsPerPeriod	= 20,
+} WarpStatisticsConstants;
+
+typedef struct
+{
+	/*
+	 *	Welford running mean and sum of squared deviations, both kept in Q8
+	 *	so that neither truncates to zero for small signals.
+	 */
+	uint32_t	sampleCount;
+	int32_t		meanQ8;
+	uint64_t	m2Q8;
+	int32_t		minimum;
+	int32_t		maximum;
+} WarpStatisticsAccumulator;
+
+typedef enum
+{
+	kWarpPowerMeterModeWindow,
+	kWarpPowerMeterModeCycleSynchronised,
+} WarpPowerMeterMode;
+
+typedef enum
+{
+	/*
+	 *	100ms of 50Hz mains per result. Hysteresis is in shunt register LSBs
+	 *	and rejects noise around zero; without a crossing in MaxSamples the
+	 *	signal is treated as DC and reported unsynchronised.
+	 */
+	kWarpCycleRmsCyclesPerResult		= 5,
+	kWarpCycleRmsHysteresis			= 16,
+	kWarpCycleRmsMaxSamples			= 250,
+} WarpCycleRmsConstants;
+
+typedef struct
+{
+	/*
+	 *	Squares of the samples since the last result's closing crossing.
+	 *	startFractionQ8 is where in the first sample's period that crossing
+	 *	fell, so the window length is known to a fraction of a sample.
+	 */
+	uint64_t	sumOfSquares;
+	uint32_t	sampleCount;
+	int32_t		startFractionQ8;
+	int32_t		previousSample;
+	bool		armed;
+	bool		locked;
+	uint8_t		cycleCount;
+
+	/*
+	 *	Latest result. periodQ8 is samples per mains cycle.
+	 */
+	uint32_t	rmsQ8;
+	uint32_t	periodQ8;
+	uint32_t	resultCount;
+	bool		resultLocked;
+} WarpCycleRmsAccumulator;
+
+typedef enum
+{
+	/*
+	 *	Fundamental plus the 3rd, 5th, 7th and 9th harmonics. Harmonics above
+	 *	0.46 of the sample rate (e.g., the 9th of 60Hz at 1kHz sampling) are
+	 *	left out: close to Nyquist, leakage from the fundamental at the
+	 *	fractional-sample block edges swamps them.
+	 */
+	kWarpHarmonicsCount			= 5,
+	kWarpHarmonicsMaxTurnsQ16		= 30147,
+} WarpHarmonicsConstants;
+
+typedef struct
+{
+	/*
+	 *	One Goertzel filter per harmonic, coefficient 2cos(w) in Q14.
+	 */
+	int32_t		coefficientQ14[kWarpHarmonicsCount];
+	int32_t		s1[kWarpHarmonicsCount];
+	int32_t		s2[kWarpHarmonicsCount];
+	uint8_t		harmonicsInBand;
+	uint32_t	sampleCount;
+	bool		tuned;
+
+	/*
+	 *	Latest result: peak amplitude of each harmonic in Q8 register LSBs,
+	 *	and total harmonic distortion relative to the fundamental.
+	 */
+	uint32_t	amplitudeQ8[kWarpHarmonicsCount];
+	uint32_t	thdPerMille;
+	uint32_t	resultCount;
+} WarpHarmonicAnalyser;
+
+typedef enum
+{
+	/*
+	 *	The last two 1KB sectors of the 32KB P-Flash are kept out of m_text
+	 *	in the linker script and hold the energy checkpoint records.
+	 */
+	kWarpEnergyFlashBase			= 0x7800,
+	kWarpEnergyFlashSectorBytes		= 1024,
+	kWarpEnergyFlashSectorCount		= 2,
+
+	/*
+	 *	At most this much energy is lost on a reset. With 42 records per
+	 *	sector, each sector is erased once every 7 hours.
+	 */
+	kWarpEnergyCheckpointSeconds		= 300,
+
+	/*
+	 *	RAM copy of the C90TFS FlashCommandSequence. The KL03 has a single
+	 *	flash block, so the launch-and-wait loop cannot run from flash.
+	 */
+	kWarpEnergyFlashLaunchCommandBytes	= 128,
+} WarpEnergyConstants;
+
+/*
+ *	One checkpoint, appended to flash. Erased flash reads as 0xFF, which
+ *	never has a valid checksum.
+ */
+typedef struct
+{
+	uint32_t	sequence;
+	uint32_t	bootCount;
+	uint32_t	rtcSeconds;
+	uint32_t	checksum;
+	uint64_t	microjoules;
+} WarpEnergyRecord;
+
+typedef struct
+{
+	/*
+	 *	Total energy in microjoules: a 64-bit fixed-point Wh count with an
+	 *	LSB of 1/3.6e9 Wh. The remainder carries sub-microjoule energy from
+	 *	window to window so nothing is lost to truncation.
+	 */
+	uint64_t	microjoules;
+	uint32_t	remainderNanojoules;
+
+	uint32_t	sequence;
+	uint32_t	bootCount;
+	uint32_t	lastCheckpointSeconds;
+	uint16_t	nextRecord;
+	WarpStatus	lastFlashStatus;
+} WarpEnergyIntegrator;
+
+/*
+ *	A GPIO pin resolved once to its single-cycle IOPORT (FGPIO) alias and
+ *	bit mask, for pins toggled on every transfer (e.g., /CS and DC). The
+ *	set/clear/toggle registers only affect the bits written as 1, so a
+ *	single store is atomic with respect to interrupts touching other pins
+ *	on the same port.
+ */
+typedef struct
+{
+	FGPIO_Type *	port;
+	uint32_t	mask;
+} WarpFastGpio;
+
 WarpStatus	warpSetLowPowerMode(WarpPowerMode powerMode, uint32_t sleepSeconds);
 void		enableI2Cpins(uint16_t pullupValue);
 void		disableI2Cpins(void);
 void		enableSPIpins(void);
 void		disableSPIpins(void);
+uint32_t	warpSquareRoot64(uint64_t value);
+void		warpRmsReset(WarpRmsAccumulator *  accumulator);
+void		warpRmsAddSample(WarpRmsAccumulator *  accumulator, int32_t sample);
+uint32_t	warpRmsGetQ8(WarpRmsAccumulator *  accumulator);
+int32_t		warpPowerFromRmsQ8(uint32_t rmsQ8, uint32_t scaleQ16);
+uint32_t	warpPowerMilliwattsFromRmsQ8(uint32_t rmsQ8, uint32_t scaleQ16);
+void		warpStatisticsReset(WarpStatisticsAccumulator volatile *  statistics);
+void		warpStatisticsAddSample(WarpStatisticsAccumulator volatile *  statistics, int32_t sample);
+void		warpStatisticsMerge(WarpStatisticsAccumulator *  into, const WarpStatisticsAccumulator *  from);
+int32_t		warpStatisticsGetMeanQ8(const WarpStatisticsAccumulator *  statistics);
+uint64_t	warpStatisticsGetVarianceQ8(const WarpStatisticsAccumulator *  statistics);
+uint32_t	warpStatisticsGetRmsQ8(const WarpStatisticsAccumulator *  statistics);
+uint32_t	warpStatisticsGetPeak(const WarpStatisticsAccumulator *  statistics);
+uint32_t	warpStatisticsGetPeakToPeak(const WarpStatisticsAccumulator *  statistics);
+uint32_t	warpStatisticsGetCrestFactorQ8(const WarpStatisticsAccumulator *  statistics);
+void		warpCycleRmsReset(WarpCycleRmsAccumulator *  accumulator);
+void		warpCycleRmsRestart(WarpCycleRmsAccumulator *  accumulator);
+bool		warpCycleRmsAddSample(WarpCycleRmsAccumulator *  accumulator, int32_t sample);
+uint32_t	warpCycleRmsGetFrequencyCentihertz(const WarpCycleRmsAccumulator *  accumulator, uint32_t samplePeriodMicroseconds);
+int32_t		warpCosineQ14(uint16_t angleTurnsQ16);
+void		warpHarmonicsTune(WarpHarmonicAnalyser *  analyser, uint32_t periodQ8);
+void		warpHarmonicsAddSample(WarpHarmonicAnalyser *  analyser, int32_t sample);
+bool		warpHarmonicsFinish(WarpHarmonicAnalyser *  analyser);
+WarpStatus	warpEnergyRestore(WarpEnergyIntegrator *  energy);
+void		warpEnergyAdd(WarpEnergyIntegrator *  energy, uint32_t powerMilliwatts, uint32_t durationMicroseconds);
+uint32_t	warpEnergyGetMilliwattHours(const WarpEnergyIntegrator *  energy);
+WarpStatus	warpEnergyCheckpointIfDue(WarpEnergyIntegrator *  energy, uint32_t rtcSeconds);
+WarpStatus	warpRegmapWrite(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t deviceRegister, uint16_t payload);
+WarpStatus	warpRegmapRead(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t deviceRegister, int numberOfBytes);
+WarpStatus	warpRegmapReadAgain(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, int numberOfBytes);
+uint16_t	warpRegmapGetValue(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t index);
+WarpStatus	warpRegmapTuneSpeed(const WarpRegmap *  map, WarpI2CDeviceState volatile *  deviceStatePointer, uint8_t probeRegister, uint16_t readsPerSpeed);
+void		warpI2CSelectDevice(WarpI2CDeviceState volatile *  deviceStatePointer, i2c_device_t *  slave);
+WarpStatus	warpI2CQueueSubmit(WarpI2CTransaction *  transaction);
+bool		warpI2CQueueIsIdle(void);
+WarpStatus	warpI2CQueueWait(uint32_t timeoutMilliseconds);
+const WarpI2CQueueStatistics *	warpI2CQueueGetStatistics(void);
+WarpStatus	warpI2CBusRecover(void);
+void		warpI2CSetRetryPolicy(uint8_t maxRetries, uint16_t backoffMicroseconds);
+const WarpI2CRetryPolicy *	warpI2CGetRetryPolicy(void);
+bool		warpI2CRetryAfter(WarpI2CDeviceState volatile *  deviceStatePointer, i2c_status_t status, uint8_t attempt);
+const WarpI2CBusHealth *	warpI2CGetBusHealth(void);
+void		warpI2CPrintHealth(const char *  name, WarpI2CDeviceState volatile *  deviceStatePointer);
+bool		warpI2CRegistryProbe(const WarpI2CProbe *  probe);
+uint32_t	warpI2CRegistryScan(const WarpI2CProbe *  probes, uint8_t probeCount);
+bool		warpI2CRegistryIsPresent(WarpSensorDevice sensor);
+void		warpI2CRegistryPrint(void);
+void		warpFastGpioInit(WarpFastGpio *  pin, uint32_t pinName);
+
+/*
+ *	These are in the header so they inline at the call site: going through
+ *	GPIO_DRV_*PinOutput() costs a call, a base-address table lookup and a
+ *	store over the peripheral bridge, for what is one IOPORT store here.
+ */
+static inline void
+warpFastGpioSet(const WarpFastGpio *  pin)
+{
+	pin->port->PSOR = pin->mask;
+}
+
+static inline void
+warpFastGpioClear(const WarpFastGpio *  pin)
+{
+	pin->port->PCOR = pin->mask;
+}
+
+static inline void
+warpFastGpioToggle(const WarpFastGpio *  pin)
+{
+	pin->port->PTOR = pin->mask;
+}
@@ -241,6 +241,33 @@ i2c_status_t I2C_DRV_MasterReceiveData(uint32_t  instance,
 i2c_status_t I2C_DRV_MasterGetReceiveStatus(uint32_t instance,
                                             uint32_t *bytesRemaining);
 
+/*!
+ * @brief Performs a polled register read on the I2C bus.
+ *
+ * For short (1-3 byte) register reads, where the semaphore wait and per-byte
+ * interrupt handling of I2C_DRV_MasterReceiveDataBlocking() cost more than
+ * the bytes on the wire. Writes cmdBuff (if any), sends a repeated start, reads
+ * rxSize bytes and sends STOP, polling with the I2C interrupt disabled.
+ *
+ * @param instance   Instance number of the I2C module.
+ * @param device     The pointer to the device information structure.
+ * @param cmdBuff    The pointer to the commands to be transferred, could be NULL.
+ * @param cmdSize    The length in bytes of the commands to be transferred, could be 0.
+ * @param rxBuff     The pointer to the data to be received, cannot be NULL.
+ * @param rxSize     The length in bytes of the data to be received, cannot be 0.
+ * @param timeout_ms The minimum time to wait for each byte.
+ * @return kStatus_I2C_Success, kStatus_I2C_Busy, kStatus_I2C_ReceivedNak,
+ *         kStatus_I2C_AribtrationLost, kStatus_I2C_Timeout or
+ *         kStatus_I2C_StopSignalFail.
+ */
+i2c_status_t I2C_DRV_MasterReceiveDataFast(uint32_t instance,
+                                           const i2c_device_t * device,
+                                           const uint8_t * cmdBuff,
+                                           uint32_t cmdSize,
+                                           uint8_t * rxBuff,
+                                           uint32_t rxSize,
+                                           uint32_t timeout_ms);
+
 /*!
  * @brief Performs a polling receive transaction on the I2C bus.
  *
@@ -69,6 +69,8 @@ static i2c_status_t I2C_DRV_MasterReceive(uint32_t instance,
                                           uint32_t rxSize,
                                           uint32_t timeout_ms,
                                           bool isBlocking);
+static i2c_status_t I2C_DRV_PollByte(uint32_t baseAddr, uint32_t spins);
+static i2c_status_t I2C_DRV_WriteBytePolled(uint32_t baseAddr, uint8_t byte, uint32_t spins);
 
 /*******************************************************************************
  * Code
@@ -806,6 +808,179 @@ static i2c_status_t I2C_DRV_MasterReceive(uint32_t instance,
     return master->status;
 }
 
+/*FUNCTION**********************************************************************
+ *
+ * Function Name : I2C_DRV_MasterReceiveDataFast
+ * Description   : Performs a polled register read on the I2C bus.
+ * The I2C interrupt stays disabled and the interrupt flag is polled for each
+ * byte, so there is no semaphore and no per-byte interrupt entry. Meant for
+ * short transfers; each byte is given at least timeout_ms to complete.
+ *
+ *END**************************************************************************/
+i2c_status_t I2C_DRV_MasterReceiveDataFast(uint32_t instance,
+                                           const i2c_device_t * device,
+                                           const uint8_t * cmdBuff,
+                                           uint32_t cmdSize,
+                                           uint8_t * rxBuff,
+                                           uint32_t rxSize,
+                                           uint32_t timeout_ms)
+{
+    assert(instance < HW_I2C_INSTANCE_COUNT);
+    assert(rxBuff);
+    assert(rxSize);
+
+    uint32_t baseAddr = g_i2cBaseAddr[instance];
+    i2c_master_state_t * master = (i2c_master_state_t *)g_i2cStatePtr[instance];
+    uint8_t addrByte = (uint8_t)(device->address << 1U);
+    i2c_status_t status = kStatus_I2C_Success;
+    uint32_t spins;
+    uint32_t i;
+
+    /* Return if current instance is used */
+    if (!master->i2cIdle)
+    {
+        return kStatus_I2C_Busy;
+    }
+
+    master->i2cIdle = false;
+
+    I2C_DRV_MasterSetBaudRate(instance, device);
+
+    /* A poll iteration takes at least 4 core cycles. */
+    spins = (CLOCK_SYS_GetCoreClockFreq() / 4000U) * timeout_ms;
+
+    I2C_HAL_SetIntCmd(baseAddr, false);
+    I2C_HAL_ClearInt(baseAddr);
+    I2C_HAL_SetDirMode(baseAddr, kI2CSend);
+    I2C_HAL_SendStart(baseAddr);
+
+    /* Write the register pointer, then turn the bus around with a repeated start. */
+    if (cmdBuff)
+    {
+        status = I2C_DRV_WriteBytePolled(baseAddr, addrByte, spins);
+
+        for (i = 0; (i < cmdSize) && (status == kStatus_I2C_Success); i++)
+        {
+            status = I2C_DRV_WriteBytePolled(baseAddr, cmdBuff[i], spins);
+        }
+
+        if (status == kStatus_I2C_Success)
+        {
+            I2C_HAL_SendStart(baseAddr);
+        }
+    }
+
+    if (status == kStatus_I2C_Success)
+    {
+        status = I2C_DRV_WriteBytePolled(baseAddr, addrByte | 1U, spins);
+    }
+
+    if (status == kStatus_I2C_Success)
+    {
+        I2C_HAL_SetDirMode(baseAddr, kI2CReceive);
+
+        /* Send NAK if only one byte to read. */
+        if (rxSize == 0x1U)
+        {
+            I2C_HAL_SendNak(baseAddr);
+        }
+        else
+        {
+            I2C_HAL_SendAck(baseAddr);
+        }
+
+        /* Dummy read to trigger receive of the first byte. */
+        I2C_HAL_ReadByte(baseAddr);
+
+        for (i = 0; i < rxSize; i++)
+        {
+            status = I2C_DRV_PollByte(baseAddr, spins);
+            if (status != kStatus_I2C_Success)
+            {
+                break;
+            }
+
+            if (i == rxSize - 1)
+            {
+                /* STOP before reading the last byte, so no further byte is clocked in. */
+                status = I2C_HAL_SendStop(baseAddr);
+            }
+            else if (i == rxSize - 2)
+            {
+                /* For the byte before last, we need to set NAK */
+                I2C_HAL_SendNak(baseAddr);
+            }
+
+            rxBuff[i] = I2C_HAL_ReadByte(baseAddr);
+        }
+    }
+
+    if ((status != kStatus_I2C_Success) && I2C_HAL_GetStatusFlag(baseAddr, kI2CBusBusy))
+    {
+        /* Generate stop signal. */
+        I2C_HAL_SendStop(baseAddr);
+    }
+
+    /* Indicate I2C bus is idle. */
+    master->i2cIdle = true;
+
+    return status;
+}
+
+/*FUNCTION**********************************************************************
+ *
+ * Function Name : I2C_DRV_PollByte
+ * Description   : Wait for the current byte to complete by polling the
+ * interrupt flag, giving up after spins iterations.
+ * This function is a static function which will be called by other data
+ * transaction APIs.
+ *
+ *END**************************************************************************/
+static i2c_status_t I2C_DRV_PollByte(uint32_t baseAddr, uint32_t spins)
+{
+    while (!I2C_HAL_GetStatusFlag(baseAddr, kI2CInterruptPending))
+    {
+        if (--spins == 0)
+        {
+            return kStatus_I2C_Timeout;
+        }
+    }
+
+    I2C_HAL_ClearInt(baseAddr);
+
+    if (I2C_HAL_GetStatusFlag(baseAddr, kI2CArbitrationLost))
+    {
+        I2C_HAL_ClearArbitrationLost(baseAddr);
+
+        return kStatus_I2C_AribtrationLost;
+    }
+
+    return kStatus_I2C_Success;
+}
+
+/*FUNCTION**********************************************************************
+ *
+ * Function Name : I2C_DRV_WriteBytePolled
+ * Description   : Send one byte and wait for it, checking for a NAK.
+ * This function is a static function which will be called by other data
+ * transaction APIs.
+ *
+ *END**************************************************************************/
+static i2c_status_t I2C_DRV_WriteBytePolled(uint32_t baseAddr, uint8_t byte, uint32_t spins)
+{
+    i2c_status_t status;
+
+    I2C_HAL_WriteByte(baseAddr, byte);
+
+    status = I2C_DRV_PollByte(baseAddr, spins);
+    if ((status == kStatus_I2C_Success) && I2C_HAL_GetStatusFlag(baseAddr, kI2CReceivedNak))
+    {
+        status = kStatus_I2C_ReceivedNak;
+    }
+
+    return status;
+}
+
 /*******************************************************************************
  * EOF
  ******************************************************************************/
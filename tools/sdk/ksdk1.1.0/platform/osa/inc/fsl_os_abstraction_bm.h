@@ -158,6 +158,46 @@ void OSA_PollAllOtherTasks(void);
 
 /* @} */
 
+/*!
+ * @name Microsecond time (bare metal only)
+ * @{
+ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus*/
+
+/*!
+ * @brief Delays execution for a number of microseconds.
+ *
+ * @param delay The time in microseconds to wait.
+ */
+void OSA_TimeDelayUs(uint32_t delay);
+
+/*!
+ * @brief Gets the current time since OSA_Init in microseconds.
+ *
+ * Unlike OSA_TimeGetMsec, this does not wrap. It is backed by SysTick, which
+ * is clocked from the core clock, so OSA_TimeUpdateClock must be called
+ * whenever the core clock changes.
+ *
+ * @return Current time in microseconds.
+ */
+uint64_t OSA_TimeGetUsec(void);
+
+/*!
+ * @brief Re-derives the SysTick period from the current core clock.
+ *
+ * The microsecond count carries on from where it was.
+ */
+void OSA_TimeUpdateClock(void);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus*/
+
+/* @} */
+
 /*!
  * @name Message queues
  * @{
@@ -38,6 +38,13 @@
 #define BM_LPTMR_INSTANCE 0
 #define BM_LPTMR_BASE LPTMR0_BASE
 
+/* SysTick reload period for the microsecond timestamp: 10Hz interrupts. */
+#define BM_SYSTICK_PERIOD_US 100000U
+
+/* Microseconds at the last SysTick reload, and core clock cycles per us. */
+static volatile uint64_t s_usecBase;
+static uint32_t s_cyclesPerUsec;
+
 /*FUNCTION**********************************************************************
  *
  * Function Name : time_diff
@@ -856,6 +863,92 @@ uint32_t OSA_TimeGetMsec(void)
     return LPTMR_HAL_GetCounterValue(BM_LPTMR_BASE);
 }
 
+/*FUNCTION**********************************************************************
+ *
+ * Function Name : SysTick_Handler
+ * Description   : Advances the microsecond timestamp base once per SysTick
+ * reload.
+ *
+ *END**************************************************************************/
+void SysTick_Handler(void)
+{
+    s_usecBase += BM_SYSTICK_PERIOD_US;
+}
+
+/*FUNCTION**********************************************************************
+ *
+ * Function Name : OSA_TimeGetUsec
+ * Description   : This function gets current time in microseconds.
+ *
+ *END**************************************************************************/
+uint64_t OSA_TimeGetUsec(void)
+{
+    uint32_t primask;
+    uint32_t count;
+    uint64_t base;
+
+    if (s_cyclesPerUsec == 0)
+    {
+        return (uint64_t)OSA_TimeGetMsec() * 1000;
+    }
+
+    /* Take base and count together; a reload between the two reads shows as
+     * a pending SysTick interrupt, in which case count is read again. */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    base = s_usecBase;
+    count = SysTick->VAL;
+    if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)
+    {
+        count = SysTick->VAL;
+        base += BM_SYSTICK_PERIOD_US;
+    }
+    __set_PRIMASK(primask);
+
+    return base + (SysTick->LOAD - count) / s_cyclesPerUsec;
+}
+
+/*FUNCTION**********************************************************************
+ *
+ * Function Name : OSA_TimeDelayUs
+ * Description   : This function is used to delay for a number of microseconds.
+ *
+ *END**************************************************************************/
+void OSA_TimeDelayUs(uint32_t delay)
+{
+    uint64_t timeStart = OSA_TimeGetUsec();
+
+    while ((OSA_TimeGetUsec() - timeStart) < delay)
+    {
+    }
+}
+
+/*FUNCTION**********************************************************************
+ *
+ * Function Name : OSA_TimeUpdateClock
+ * Description   : This function sets the SysTick period to
+ * BM_SYSTICK_PERIOD_US at the current core clock. The core clock must be at
+ * least 1MHz.
+ *
+ *END**************************************************************************/
+void OSA_TimeUpdateClock(void)
+{
+    uint64_t now = OSA_TimeGetUsec();
+    uint32_t cyclesPerUsec = CLOCK_SYS_GetCoreClockFreq() / 1000000U;
+
+    if (cyclesPerUsec == 0)
+    {
+        cyclesPerUsec = 1;
+    }
+
+    SysTick->CTRL = 0;
+    s_usecBase = now;
+    s_cyclesPerUsec = cyclesPerUsec;
+    SysTick->LOAD = BM_SYSTICK_PERIOD_US * cyclesPerUsec - 1;
+    SysTick->VAL = 0;
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+}
+
 /*FUNCTION**********************************************************************
  *
  * Function Name : interrupt_handler_register
@@ -941,6 +1034,9 @@ osa_status_t OSA_Init(void)
 
     LPTMR_HAL_Enable(BM_LPTMR_BASE);
 
+    /* SysTick for the microsecond timestamp and delays. */
+    OSA_TimeUpdateClock();
+
     return kStatus_OSA_Success;
 }
 